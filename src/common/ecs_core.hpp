@@ -14,6 +14,26 @@
 #include <bitset>
 #include <cassert>
 #include <unordered_map>
+#include <mutex>
+#include <future>
+#include <numeric>
+#include <new>
+#include <cstring>
+#include <span>
+#include <memory_resource>
+#include <utility>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <ostream>
+#include <typeinfo>
+#if __has_include(<cxxabi.h>)
+#include <cxxabi.h>
+#endif
+
+#include "threadpool.hpp"
+#include <tuple>
+#include <array>
 
 
 namespace ecs {
@@ -21,20 +41,94 @@ namespace ecs {
   using EntID = uint32_t;
   using TypeID = uint32_t;
   constexpr EntID NULL_ENT = std::numeric_limits<EntID>::max();
+  
+  // EntID = | generation: 12 | index: 20 |
+  // index addresses signatures/sparse arrays and is recycled after destroy,
+  // generation is bumped on every destroy so stale copies can be detected
+  constexpr uint32_t ENT_INDEX_BITS = 20;
+  constexpr EntID ENT_INDEX_MASK = (1u << ENT_INDEX_BITS) - 1;
+  constexpr uint32_t ENT_GEN_MASK = (1u << (32 - ENT_INDEX_BITS)) - 1;
+  
+  constexpr uint32_t entIndex(EntID e) {return e & ENT_INDEX_MASK;}
+  constexpr uint32_t entGen(EntID e) {return e >> ENT_INDEX_BITS;}
+  constexpr EntID makeEnt(uint32_t idx, uint32_t gen) {
+    return ((gen & ENT_GEN_MASK) << ENT_INDEX_BITS) | (idx & ENT_INDEX_MASK);
+  }
   constexpr size_t MAX_COMPONENTS = 64;
+  constexpr size_t CACHE_LINE = 64;
   using Signature = std::bitset<MAX_COMPONENTS>;
   
+  // last signature bit isn't a component, it marks disabled entities (Manager::disable)
+  constexpr TypeID DISABLED_BIT = MAX_COMPONENTS - 1;
+  
+  // mask with every Ts set that also rejects disabled entities:  (sig & test) == mask
+  inline Signature enabledTest(const Signature& mask) {
+    return Signature(mask).set(DISABLED_BIT);
+  }
+  
+  template <typename... Ts>
+  struct TypeList {};
+  
+  template <typename T, typename... Ts>
+  constexpr bool contains(TypeList<Ts...>) {return (std::is_same_v<T, Ts> || ...);}
+  
+  // position of T in the list, sizeof...(Ts) when missing
+  template <typename T, typename... Ts>
+  constexpr size_t indexOf(TypeList<Ts...>) {
+    size_t idx = 0;
+    ((std::is_same_v<T, Ts> ? false : (++idx, true)) && ...);
+    return idx;
+  }
+  
+  template <typename T, typename List>
+  concept InList = contains<T>(List{});
+  
+  // Optional compile-time ids, specialize with static constexpr TypeID id, e.g. for a list
+  //   template <typename T> requires ecs::InList<T, Components>
+  //   struct ecs::ComponentInfo<T> { static constexpr ecs::TypeID id = ecs::indexOf<T>(Components{}); };
+  // Such components cost no guard/atomic and get the same id every run. The rest get
+  // dynamic ids counted down from DISABLED_BIT - 1 so both ranges don't collide.
+  template <typename T>
+  struct ComponentInfo {};
+  
+  template <typename T>
+  concept StaticComponent = requires {
+    {ComponentInfo<T>::id} -> std::convertible_to<TypeID>;
+  };
+  
   inline TypeID getNextID() {
     static std::atomic<TypeID> counter{0};
-    return counter++;
+    const TypeID n = counter++;
+    assert(n < DISABLED_BIT && "Too many component types!");
+    return static_cast<TypeID>(DISABLED_BIT - 1 - n);
   }
   
   template <typename T>
-  inline TypeID getComponentID() {
+  inline TypeID dynamicComponentID() {
     static const TypeID id = getNextID();
     return id;
   }
   
+  inline uint32_t getNextResourceID() {
+    static std::atomic<uint32_t> counter{0};
+    return counter++;
+  }
+  
+  template <typename T>
+  inline uint32_t getResourceID() {
+    static const uint32_t id = getNextResourceID();
+    return id;
+  }
+  
+  template <typename T>
+  constexpr TypeID getComponentID() {
+    if constexpr (StaticComponent<T>) {
+      static_assert(ComponentInfo<T>::id < DISABLED_BIT, "Static component id out of range!");
+      return ComponentInfo<T>::id;
+    }
+    else return dynamicComponentID<T>();
+  }
+  
   struct StrTransparentHash {
     using is_transparent = void;
     size_t operator()(const char * txt) const {return std::hash<std::string_view>{}(txt);}
@@ -58,12 +152,54 @@ namespace ecs {
   
   
   class Manager;
-
+  
+  // Systems may declare component access with member aliases
+  //   using Reads = ecs::TypeList<A, B>;
+  //   using Writes = ecs::TypeList<C>;
+  // Declared systems only touch those storages and do structural changes through
+  // Manager::commands(), so non-conflicting ones run in parallel. Undeclared systems
+  // are exclusive: they run alone on the calling thread (input, ImGui, rendering).
   struct ISystem {
     virtual ~ISystem() = default;
     virtual void update(Manager& ecs, const float dt) = 0;
+    
+    // after Manager::loadSnapshot replaced the world, entity ids and per entity
+    // state the system kept from before are stale: drop them or look them up again
+    virtual void onLoad(Manager&) {}
+    
+    // change tick of the previous update, pass to Query::added/changed and
+    // Manager::isAdded/isChanged to see what happened since then
+    uint32_t lastRun = 0;
+  };
+  
+  struct Access {
+    Signature reads;
+    Signature writes;
+    bool exclusive = true;
+    
+    bool conflicts(const Access& o) const {
+      if(exclusive || o.exclusive) return true;
+      return (writes & (o.reads | o.writes)).any() || (o.writes & reads).any();
+    }
+  };
+  
+  
+  //==========================================
+  // RESOURCES
+  //==========================================
+  
+  // world-wide singletons owned by the Manager, not attached to any entity
+  struct IResource {
+    virtual ~IResource() = default;
   };
   
+  template <typename T>
+  struct Resource : IResource {
+    T value;
+    
+    template <typename... Args>
+    Resource(Args&&... args) : value{std::forward<Args>(args)...} {}
+  };
   
   //==========================================
   // ASSETS
@@ -158,186 +294,1990 @@ namespace ecs {
     
   };
   
+  //==========================================
+  // SNAPSHOTS
+  //==========================================
+  
+  // flat byte buffer, everything is written in native layout/endianness
+  class SnapshotWriter {
+    std::vector<std::byte> buf;
+    
+  public:
+    void write(const void* data, size_t size) {
+      const auto* p = static_cast<const std::byte*>(data);
+      buf.insert(buf.end(), p, p + size);
+    }
+    
+    template <typename T>
+    void value(const T& v) {
+      static_assert(std::is_trivially_copyable_v<T>);
+      write(&v, sizeof(T));
+    }
+    
+    // overwrite an already written value, for sizes known only afterwards
+    template <typename T>
+    void patch(size_t at, const T& v) {
+      assert(at + sizeof(T) <= buf.size());
+      std::memcpy(buf.data() + at, &v, sizeof(T));
+    }
+    
+    size_t size() const {return buf.size();}
+    std::vector<std::byte> take() {return std::move(buf);}
+  };
+  
+  // reading past the end zero fills and sets ok() to false for good
+  class SnapshotReader {
+    const std::byte* cur;
+    const std::byte* end;
+    bool good = true;
+    
+  public:
+    explicit SnapshotReader(std::span<const std::byte> data) : cur(data.data()), end(data.data() + data.size()) {}
+    
+    bool read(void* out, size_t size) {
+      if(!good || static_cast<size_t>(end - cur) < size) {
+        good = false;
+        if(size) std::memset(out, 0, size);
+        return false;
+      }
+      if(size) std::memcpy(out, cur, size);
+      cur += size;
+      return true;
+    }
+    
+    template <typename T>
+    T value() {
+      static_assert(std::is_trivially_copyable_v<T>);
+      T v;
+      read(&v, sizeof(T));
+      return v;
+    }
+    
+    bool skip(size_t size) {
+      if(!good || static_cast<size_t>(end - cur) < size) return good = false;
+      cur += size;
+      return true;
+    }
+    
+    // a count read from the data is only trusted when that many items can follow,
+    // check before sizing anything by it
+    bool fits(size_t cnt, size_t itemSize) {
+      if(!good || (itemSize && cnt > remaining() / itemSize)) return good = false;
+      return true;
+    }
+    
+    bool ok() const {return good;}
+    size_t remaining() const {return static_cast<size_t>(end - cur);}
+  };
+  
+  // Per component (de)serialization for types that can't be block copied
+  // (owning pointers, handles, coroutines). Set with Manager::setSnapshotHook<T>().
+  template <typename T>
+  struct SnapshotHook {
+    std::function<void(SnapshotWriter&, const T&)> save;
+    std::function<T(SnapshotReader&)> load;
+  };
+  
+  // dense arrays of these are written/read with a single memcpy
+  template <typename T>
+  concept BlockCopyable = std::is_trivially_copyable_v<T> && std::is_default_constructible_v<T>;
+  
   //==========================================
   // COMPONENTS
   //==========================================
   
+  // change ticks of a component slot, zeros when the entity has no such component
+  struct ComponentTicks {
+    uint32_t added = 0;
+    uint32_t changed = 0;
+  };
+  
+  // Moves slots [0, order.size()) so new slot i holds what old slot order[i] had.
+  // Done as swap(a, b) cycles, storages pass their swapSlots to keep sparse in sync.
+  template <typename Swap>
+  void applyOrder(std::span<const uint32_t> order, Swap&& swap) {
+    std::vector<bool> done(order.size(), false);
+    for(uint32_t i = 0; i < order.size(); ++i) {
+      if(done[i]) continue;
+      uint32_t j = i;
+      while(order[j] != i) {
+        swap(j, order[j]);
+        done[j] = true;
+        j = order[j];
+      }
+      done[j] = true;
+    }
+  }
+  
   struct IComponentStor {
     virtual ~IComponentStor() = default;
     virtual void remove(EntID id) = 0;
+    virtual ComponentTicks ticksOf(EntID id) const = 0;
+    
+    virtual void clear() = 0;
+    // false if the storage can't be saved (not block copyable, no hook)
+    virtual bool save(SnapshotWriter& w) const = 0;
+    // replaces the content, false on truncated data
+    virtual bool load(SnapshotReader& r) = 0;
+    // entity of each dense slot
+    virtual std::span<const EntID> owners() const = 0;
+  };
+  
+  // Entity index -> dense index map split into fixed pages. Pages are allocated
+  // on first write and released when empty, unallocated ones point to a shared
+  // read-only page of NULL_ENT so lookups don't branch on page presence.
+  class SparsePages {
+  public:
+    static constexpr uint32_t PAGE_BITS = 12;
+    static constexpr uint32_t PAGE_SIZE = 1u << PAGE_BITS;
+    
+  private:
+    std::pmr::memory_resource* res;
+    std::pmr::vector<EntID*> pages;
+    std::pmr::vector<uint32_t> pageCnt;
+    
+    static EntID* nullPage() {
+      static const auto page = [] {
+        std::array<EntID, PAGE_SIZE> p;
+        p.fill(NULL_ENT);
+        return p;
+      }();
+      return const_cast<EntID*>(page.data()); // never written, see set()
+    }
+    
+  public:
+    explicit SparsePages(std::pmr::memory_resource* r = std::pmr::get_default_resource())
+      : res(r), pages(r), pageCnt(r) {}
+    SparsePages(const SparsePages&) = delete;
+    SparsePages& operator=(const SparsePages&) = delete;
+    ~SparsePages() {clear();}
+    
+    EntID get(uint32_t idx) const {
+      const uint32_t p = idx >> PAGE_BITS;
+      return p < pages.size() ? pages[p][idx & (PAGE_SIZE - 1)] : NULL_ENT;
+    }
+    
+    void set(uint32_t idx, EntID val) {
+      assert(val != NULL_ENT && "Use reset() to clear an entry");
+      const uint32_t p = idx >> PAGE_BITS;
+      if(p >= pages.size()) {
+        pages.resize(p + 1, nullPage());
+        pageCnt.resize(p + 1, 0);
+      }
+      if(pages[p] == nullPage()) {
+        pages[p] = static_cast<EntID*>(res->allocate(PAGE_SIZE * sizeof(EntID), alignof(EntID)));
+        std::fill_n(pages[p], PAGE_SIZE, NULL_ENT);
+      }
+      
+      EntID& slot = pages[p][idx & (PAGE_SIZE - 1)];
+      if(slot == NULL_ENT) pageCnt[p]++;
+      slot = val;
+    }
+    
+    void reset(uint32_t idx) {
+      const uint32_t p = idx >> PAGE_BITS;
+      if(p >= pages.size() || pages[p] == nullPage()) return;
+      
+      EntID& slot = pages[p][idx & (PAGE_SIZE - 1)];
+      if(slot == NULL_ENT) return;
+      slot = NULL_ENT;
+      
+      if(--pageCnt[p] == 0) {
+        res->deallocate(pages[p], PAGE_SIZE * sizeof(EntID), alignof(EntID));
+        pages[p] = nullPage();
+      }
+    }
+    
+    void clear() {
+      for(EntID* page : pages) {
+        if(page != nullPage()) res->deallocate(page, PAGE_SIZE * sizeof(EntID), alignof(EntID));
+      }
+      pages.clear();
+      pageCnt.clear();
+    }
+    
+    size_t allocatedPages() const {
+      return std::count_if(pages.begin(), pages.end(), [](EntID* p) {return p != nullPage();});
+    }
   };
   
+  // sparse is indexed by entIndex(), backlink keeps full versioned ids,
+  // so a stale id whose index got recycled is not found
   template <typename T>
   class SparseSet : public IComponentStor {
-    std::vector<T> dense;
-    std::vector<EntID> sparse;
-    std::vector<EntID> backlink;
+    std::pmr::vector<T> dense;
+    SparsePages sparse;
+    std::pmr::vector<EntID> backlink;
+    std::pmr::vector<ComponentTicks> ticks;
+    uint32_t lastChange = 0; // newest tick stamped on any slot
+    std::unique_ptr<SnapshotHook<T>> hook;
+    
+    bool loadFail() {
+      clear();
+      return false;
+    }
     
   public:
-    T& add(EntID e, T&& comp) {
-      if(e >= sparse.size()) {
-        sparse.resize(e + 13, NULL_ENT);
-      }
+    // every array and sparse page comes from res
+    explicit SparseSet(std::pmr::memory_resource* res = std::pmr::get_default_resource())
+      : dense(res), sparse(res), backlink(res), ticks(res) {}
+    
+    // replacing an existing component counts as a change
+    T& add(EntID e, T&& comp, uint32_t tick = 0) {
+      const uint32_t idx = entIndex(e);
+      lastChange = std::max(lastChange, tick);
       
-      if(sparse[e] != NULL_ENT) {
-        dense[sparse[e]] = std::move(comp);
-        return dense[sparse[e]];
+      if(EntID d = sparse.get(idx); d != NULL_ENT) {
+        if(backlink[d] != e) ticks[d].added = tick;
+        ticks[d].changed = tick;
+        backlink[d] = e;
+        dense[d] = std::move(comp);
+        return dense[d];
       }
       
-      sparse[e] = static_cast<EntID>(dense.size());
+      sparse.set(idx, static_cast<EntID>(dense.size()));
       backlink.emplace_back(e);
+      ticks.push_back({tick, tick});
       dense.emplace_back(std::move(comp));
       
       return dense.back();
     }
     
+    // entities without T sharing one value, a single append per array
+    void addBulk(std::span<const EntID> ents, const T& comp, uint32_t tick = 0) {
+      const size_t base = dense.size();
+      dense.insert(dense.end(), ents.size(), comp);
+      backlink.insert(backlink.end(), ents.begin(), ents.end());
+      ticks.insert(ticks.end(), ents.size(), ComponentTicks{tick, tick});
+      lastChange = std::max(lastChange, tick);
+      for(size_t i = 0; i < ents.size(); ++i) {
+        assert(sparse.get(entIndex(ents[i])) == NULL_ENT && "Entity already has the component!");
+        sparse.set(entIndex(ents[i]), static_cast<EntID>(base + i));
+      }
+    }
+    
     void remove(EntID e) override {
-      if(e >= sparse.size() || sparse[e] == NULL_ENT) return;
+      if(!has(e)) return;
       
-      EntID removeIdx = sparse[e];
+      EntID removeIdx = sparse.get(entIndex(e));
       EntID lastIdx = static_cast<EntID>(dense.size() - 1);
       EntID lastE = backlink[lastIdx];
       if(removeIdx != lastIdx) {
         std::swap(dense[removeIdx], dense[lastIdx]);
         std::swap(backlink[removeIdx], backlink[lastIdx]);
+        std::swap(ticks[removeIdx], ticks[lastIdx]);
         
-        sparse[lastE] = removeIdx;
+        sparse.set(entIndex(lastE), removeIdx);
       }
       
       dense.pop_back();
       backlink.pop_back();
-      sparse[e] = NULL_ENT;
+      ticks.pop_back();
+      sparse.reset(entIndex(e));
     }
     
     T* get(EntID e) {
-      if(e >= sparse.size() || sparse[e] == NULL_ENT) return nullptr;
+      if(!has(e)) return nullptr;
       
-      return &dense[sparse[e]];
+      return &dense[sparse.get(entIndex(e))];
+    }
+    
+    bool has(EntID e) const {
+      const EntID d = sparse.get(entIndex(e));
+      return d != NULL_ENT && backlink[d] == e;
+    }
+    
+    // unchecked access, caller guarantees has(e)
+    T& at(EntID e) {
+      assert(has(e));
+      return dense[sparse.get(entIndex(e))];
+    }
+    
+    T& byIndex(size_t i) {return dense[i];}
+    
+    ComponentTicks ticksOf(EntID e) const override {
+      return has(e) ? ticks[sparse.get(entIndex(e))] : ComponentTicks{};
+    }
+    
+    void markChanged(EntID e, uint32_t tick) {
+      if(!has(e)) return;
+      ticks[sparse.get(entIndex(e))].changed = tick;
+      lastChange = std::max(lastChange, tick);
+    }
+    
+    // any slot added or marked changed after tick since, removals only show in size()
+    bool changedSince(uint32_t since) const {return lastChange > since;}
+    
+    size_t size() const {return dense.size();}
+    
+    size_t index(EntID e) const {
+      assert(has(e));
+      return sparse.get(entIndex(e));
+    }
+    
+    // keeps sparse/backlink in sync, used by groups to reorder dense
+    void swapSlots(size_t a, size_t b) {
+      if(a == b) return;
+      std::swap(dense[a], dense[b]);
+      std::swap(backlink[a], backlink[b]);
+      std::swap(ticks[a], ticks[b]);
+      sparse.set(entIndex(backlink[a]), static_cast<EntID>(a));
+      sparse.set(entIndex(backlink[b]), static_cast<EntID>(b));
     }
     
-    bool has(EntID e) {
-      return e < sparse.size() && sparse[e] != NULL_ENT;
+    // cmp(const T&, const T&), storages owned by a group are sorted through the group
+    template <typename Cmp>
+    void sortBy(Cmp&& cmp) {
+      std::vector<uint32_t> order(dense.size());
+      std::iota(order.begin(), order.end(), 0u);
+      std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return cmp(std::as_const(dense[a]), std::as_const(dense[b]));
+      });
+      applyOrder(order, [this](size_t a, size_t b) {swapSlots(a, b);});
     }
     
+    size_t sparsePages() const {return sparse.allocatedPages();}
+    
     auto begin() {return dense.begin();}
     auto end() {return dense.end();}
     
-    const std::vector<EntID>& getOwners() const {return backlink;}
-    std::vector<T>& getDense() { return dense; }
-    const std::vector<T>& getDense() const { return dense; }
+    const std::pmr::vector<EntID>& getOwners() const {return backlink;}
+    std::span<const EntID> owners() const override {return backlink;}
+    std::pmr::vector<T>& getDense() { return dense; }
+    const std::pmr::vector<T>& getDense() const { return dense; }
+    
+    void setSnapshotHook(SnapshotHook<T> h) {
+      hook = std::make_unique<SnapshotHook<T>>(std::move(h));
+    }
+    
+    void clear() override {
+      dense.clear();
+      backlink.clear();
+      ticks.clear();
+      sparse.clear();
+    }
+    
+    // | count | backlink | ticks | dense, one block or per hook |
+    bool save(SnapshotWriter& w) const override {
+      if(!hook && !BlockCopyable<T>) return false;
+      
+      const uint32_t n = static_cast<uint32_t>(dense.size());
+      w.value(n);
+      w.write(backlink.data(), n * sizeof(EntID));
+      w.write(ticks.data(), n * sizeof(ComponentTicks));
+      if(hook) {
+        for(const T& comp : dense) hook->save(w, comp);
+      }
+      else if constexpr (BlockCopyable<T>) {
+        w.write(dense.data(), n * sizeof(T));
+      }
+      return true;
+    }
+    
+    bool load(SnapshotReader& r) override {
+      clear();
+      const uint32_t n = r.value<uint32_t>();
+      // hooked items may take no bytes at all, block copied ones are known
+      const size_t itemSize = sizeof(EntID) + sizeof(ComponentTicks) + (hook ? 0 : sizeof(T));
+      if(!r.fits(n, itemSize)) return loadFail();
+      backlink.resize(n);
+      ticks.resize(n);
+      if(!r.read(backlink.data(), n * sizeof(EntID)) || !r.read(ticks.data(), n * sizeof(ComponentTicks))) return loadFail();
+      
+      if(hook) {
+        dense.reserve(n);
+        for(uint32_t i = 0; i < n && r.ok(); ++i) dense.emplace_back(hook->load(r));
+      }
+      else if constexpr (BlockCopyable<T>) {
+        dense.resize(n);
+        r.read(dense.data(), n * sizeof(T));
+      }
+      if(!r.ok() || dense.size() != n) return loadFail();
+      for(const auto& t : ticks) lastChange = std::max(lastChange, t.changed);
+      
+      for(uint32_t i = 0; i < n; ++i) sparse.set(entIndex(backlink[i]), static_cast<EntID>(i));
+      return true;
+    }
   };
   
   //==========================================
-  // MANAGER
+  // SOA STORAGE
   //==========================================
   
-  class Manager {
-    std::vector<std::unique_ptr<IComponentStor>> storsOwnership;
-    std::vector<IComponentStor*> storsID;
-    std::vector<Signature> signatures;
-    std::vector<std::unique_ptr<ISystem>> systems;
+  // Opt-in struct-of-arrays layout. Specialize with T's member pointers and a Ref
+  // made of references to the same members, in the same order:
+  //   template <> struct ecs::SoALayout<Foo> {
+  //     static constexpr auto fields = std::make_tuple(&Foo::a, &Foo::b);
+  //     struct Ref { int& a; float& b; };
+  //   };
+  // Each field then gets its own cache line aligned array, hot loops take just the
+  // columns they need with view<Foo>().field<&Foo::a>().
+  template <typename T>
+  struct SoALayout;
+  
+  template <typename T>
+  concept SoAComponent = requires {
+    SoALayout<T>::fields;
+    typename SoALayout<T>::Ref;
+  };
+  
+  template <typename M>
+  struct MemberType;
+  
+  template <typename C, typename M>
+  struct MemberType<M C::*> {using type = M;};
+  
+  template <typename T, size_t Align>
+  struct AlignedAllocator {
+    using value_type = T;
+    template <typename U>
+    struct rebind {using other = AlignedAllocator<U, Align>;};
     
-    std::unordered_map<std::type_index, std::unique_ptr<IAssetStor>> assets;
-    std::unordered_map<std::type_index, std::function<rawHandle(const std::string&)>> assetLoaders;
+    static constexpr size_t ALIGN = std::max(Align, alignof(T));
+    std::pmr::memory_resource* res = std::pmr::get_default_resource();
     
-    EntID nextE = 0;
+    AlignedAllocator() = default;
+    AlignedAllocator(std::pmr::memory_resource* r) : res(r) {}
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Align>& o) : res(o.res) {}
+    
+    T* allocate(size_t n) {
+      return static_cast<T*>(res->allocate(n * sizeof(T), ALIGN));
+    }
+    void deallocate(T* p, size_t n) {
+      res->deallocate(p, n * sizeof(T), ALIGN);
+    }
+    
+    template <typename U>
+    bool operator==(const AlignedAllocator<U, Align>& o) const {return res == o.res || res->is_equal(*o.res);}
+  };
+  
+  // nullable handle returned by getComponent() for SoA components, used like T*
+  template <typename T>
+  class SoAPtr {
+    using Ref = typename SoALayout<T>::Ref;
+    std::optional<Ref> ref;
     
   public:
+    SoAPtr() = default;
+    SoAPtr(std::nullptr_t) {}
+    explicit SoAPtr(Ref r) : ref(r) {}
+    
+    // Ref only holds references, constness doesn't stop writes through it
+    const Ref* operator->() const {return &*ref;}
+    const Ref& operator*() const {return *ref;}
+    explicit operator bool() const {return ref.has_value();}
+  };
+  
+  // same entity mapping as SparseSet, but dense data is one column per field
+  template <typename T>
+  class SoASparseSet : public IComponentStor {
+    using Layout = SoALayout<T>;
+    using Ref = typename Layout::Ref;
+    using Fields = std::remove_const_t<decltype(Layout::fields)>;
+    static constexpr size_t FIELDS = std::tuple_size_v<Fields>;
     
-    Manager() = default;
+    template <typename M>
+    using Column = std::vector<typename MemberType<M>::type, AlignedAllocator<typename MemberType<M>::type, CACHE_LINE>>;
     
-    EntID createEntity() {
-      EntID id = nextE++;
-      if(signatures.size() <= id) {
-        signatures.resize(id + 13);
+    template <typename Tup>
+    struct ColumnsOf;
+    template <typename... Ms>
+    struct ColumnsOf<std::tuple<Ms...>> {
+      using type = std::tuple<Column<Ms>...>;
+      static type make(std::pmr::memory_resource* r) {
+        return type(Column<Ms>(typename Column<Ms>::allocator_type(r))...);
       }
-      signatures[id].reset();
-      
-      return id;
+    };
+    
+    typename ColumnsOf<Fields>::type cols;
+    SparsePages sparse;
+    std::pmr::vector<EntID> backlink;
+    std::pmr::vector<ComponentTicks> ticks;
+    uint32_t lastChange = 0; // newest tick stamped on any slot
+    
+    template <typename A, typename B>
+    static constexpr bool sameMember(A a, B b) {
+      if constexpr (std::is_same_v<A, B>) return a == b;
+      else return false;
     }
     
-    void destroyEntity(EntID e) {
-      Signature& mask = signatures[e];
-      
-      for(size_t i = 0; i < storsID.size(); ++i) {
-        if(mask.test(i)) {
-          storsID[i]->remove(e);
-        }
-      }
-      mask.reset();
+    template <auto M>
+    static constexpr size_t fieldIndex() {
+      return []<size_t... Is>(std::index_sequence<Is...>) {
+        size_t idx = FIELDS;
+        ((idx = (idx == FIELDS && sameMember(std::get<Is>(Layout::fields), M)) ? Is : idx), ...);
+        return idx;
+      }(std::make_index_sequence<FIELDS>{});
     }
     
-    const Signature& getSignature(EntID e) {
-      return signatures[e];
+    template <size_t... Is>
+    Ref refAt(size_t d, std::index_sequence<Is...>) {
+      return Ref{std::get<Is>(cols)[d]...};
     }
     
-    //==========================================
-    // COMPONENT MANAGEMENT
-    //==========================================
+    template <size_t... Is>
+    void store(size_t d, T& comp, std::index_sequence<Is...>) {
+      ((std::get<Is>(cols)[d] = std::move(comp.*std::get<Is>(Layout::fields))), ...);
+    }
     
-    template <typename T>
-    void registerComponent() {
-      TypeID id = getComponentID<T>();
-      
-      assert(id < MAX_COMPONENTS && "Too many component types registered!");
+    template <size_t... Is>
+    void push(T& comp, std::index_sequence<Is...>) {
+      (std::get<Is>(cols).emplace_back(std::move(comp.*std::get<Is>(Layout::fields))), ...);
+    }
+    
+    template <typename F>
+    void forColumns(F&& f) {
+      std::apply([&](auto&... col) {(f(col), ...);}, cols);
+    }
+    template <typename F>
+    void forColumns(F&& f) const {
+      std::apply([&](const auto&... col) {(f(col), ...);}, cols);
+    }
+    
+    static constexpr bool BLOCK_COPY = std::apply([](auto... m) {
+      return (BlockCopyable<typename MemberType<decltype(m)>::type> && ...);
+    }, Layout::fields);
+    
+  public:
+    explicit SoASparseSet(std::pmr::memory_resource* res = std::pmr::get_default_resource())
+      : cols(ColumnsOf<Fields>::make(res)), sparse(res), backlink(res), ticks(res) {}
+    
+    Ref add(EntID e, T&& comp, uint32_t tick = 0) {
+      const uint32_t idx = entIndex(e);
+      lastChange = std::max(lastChange, tick);
       
-      if(storsID.size() <= id) {
-        storsID.resize(id + 1, nullptr);
+      if(EntID d = sparse.get(idx); d != NULL_ENT) {
+        if(backlink[d] != e) ticks[d].added = tick;
+        ticks[d].changed = tick;
+        backlink[d] = e;
+        store(d, comp, std::make_index_sequence<FIELDS>{});
+        return byIndex(d);
       }
       
-      auto newStor = std::make_unique<SparseSet<T>>();
-      storsID[id] = newStor.get();
-      storsOwnership.emplace_back(std::move(newStor));
+      sparse.set(idx, static_cast<EntID>(backlink.size()));
+      backlink.emplace_back(e);
+      ticks.push_back({tick, tick});
+      push(comp, std::make_index_sequence<FIELDS>{});
+      
+      return byIndex(backlink.size() - 1);
     }
     
-    template <typename T>
-    T& addComponent(EntID e, T&& comp) {
-      TypeID id = getComponentID<T>();
+    void addBulk(std::span<const EntID> ents, const T& comp, uint32_t tick = 0) {
+      const size_t base = backlink.size();
+      [&]<size_t... Is>(std::index_sequence<Is...>) {
+        (std::get<Is>(cols).insert(std::get<Is>(cols).end(), ents.size(), comp.*std::get<Is>(Layout::fields)), ...);
+      }(std::make_index_sequence<FIELDS>{});
+      backlink.insert(backlink.end(), ents.begin(), ents.end());
+      ticks.insert(ticks.end(), ents.size(), ComponentTicks{tick, tick});
+      lastChange = std::max(lastChange, tick);
+      for(size_t i = 0; i < ents.size(); ++i) {
+        assert(sparse.get(entIndex(ents[i])) == NULL_ENT && "Entity already has the component!");
+        sparse.set(entIndex(ents[i]), static_cast<EntID>(base + i));
+      }
+    }
+    
+    void remove(EntID e) override {
+      if(!has(e)) return;
       
-      assert(id < storsID.size() && storsID[id] && "Component not registered before use!");
+      EntID removeIdx = sparse.get(entIndex(e));
+      EntID lastIdx = static_cast<EntID>(backlink.size() - 1);
+      EntID lastE = backlink[lastIdx];
+      if(removeIdx != lastIdx) {
+        forColumns([&](auto& col) {std::swap(col[removeIdx], col[lastIdx]);});
+        std::swap(backlink[removeIdx], backlink[lastIdx]);
+        std::swap(ticks[removeIdx], ticks[lastIdx]);
+        
+        sparse.set(entIndex(lastE), removeIdx);
+      }
       
-      signatures[e].set(id, true);
+      forColumns([](auto& col) {col.pop_back();});
+      backlink.pop_back();
+      ticks.pop_back();
+      sparse.reset(entIndex(e));
+    }
+    
+    SoAPtr<T> get(EntID e) {
+      if(!has(e)) return nullptr;
       
-      return static_cast<SparseSet<T>*>(storsID[id])->add(e, std::move(comp));
+      return SoAPtr<T>(byIndex(sparse.get(entIndex(e))));
     }
     
-    template <typename T>
-    void removeComponent(EntID e) {
-      TypeID id = getComponentID<T>();
-      signatures[e].set(id, false);
-      storsID[id]->remove(e);
+    bool has(EntID e) const {
+      const EntID d = sparse.get(entIndex(e));
+      return d != NULL_ENT && backlink[d] == e;
     }
     
-    template <typename T>
-    T* getComponent(EntID e) {
-      TypeID id = getComponentID<T>();
-      if(!signatures[e].test(id)) return nullptr;
-      
-      return static_cast<SparseSet<T>*>(storsID[id])->get(e);
+    // unchecked access, caller guarantees has(e)
+    Ref at(EntID e) {
+      assert(has(e));
+      return byIndex(sparse.get(entIndex(e)));
     }
     
-    template <typename T>
-    SparseSet<T>& view() {
-      auto typeId = getComponentID<T>();
-      assert(typeId < storsID.size() && storsID[typeId]);
-      return *static_cast<SparseSet<T>*>(storsID[typeId]);
+    Ref byIndex(size_t i) {return refAt(i, std::make_index_sequence<FIELDS>{});}
+    
+    ComponentTicks ticksOf(EntID e) const override {
+      return has(e) ? ticks[sparse.get(entIndex(e))] : ComponentTicks{};
     }
     
-    //==========================================
-    // ASSET MANAGEMENT
-    //==========================================
+    void markChanged(EntID e, uint32_t tick) {
+      if(!has(e)) return;
+      ticks[sparse.get(entIndex(e))].changed = tick;
+      lastChange = std::max(lastChange, tick);
+    }
     
-    // loader API - std::expected<T, std::string> load(const std::string&)
-    template <typename T, typename L>
-    void registerAsset(L&& l) {
-      auto pool = std::make_unique<AssetPool<T>>();
-      AssetPool<T>* rawPool = pool.get();
-      assets[std::type_index(typeid(T))] = std::move(pool);
-      
-      assetLoaders[std::type_index(typeid(T))] = [rawPool, loader = std::forward<L>(l)](const std::string& path) mutable -> rawHandle {
-        if(auto existing = rawPool->find(path)) {
-          return *existing;
-        }
+    // any slot added or marked changed after tick since, removals only show in size()
+    bool changedSince(uint32_t since) const {return lastChange > since;}
+    
+    size_t size() const {return backlink.size();}
+    
+    size_t index(EntID e) const {
+      assert(has(e));
+      return sparse.get(entIndex(e));
+    }
+    
+    void swapSlots(size_t a, size_t b) {
+      if(a == b) return;
+      forColumns([&](auto& col) {std::swap(col[a], col[b]);});
+      std::swap(backlink[a], backlink[b]);
+      std::swap(ticks[a], ticks[b]);
+      sparse.set(entIndex(backlink[a]), static_cast<EntID>(a));
+      sparse.set(entIndex(backlink[b]), static_cast<EntID>(b));
+    }
+    
+    // cmp(Ref, Ref)
+    template <typename Cmp>
+    void sortBy(Cmp&& cmp) {
+      std::vector<uint32_t> order(backlink.size());
+      std::iota(order.begin(), order.end(), 0u);
+      std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {return cmp(byIndex(a), byIndex(b));});
+      applyOrder(order, [this](size_t a, size_t b) {swapSlots(a, b);});
+    }
+    
+    size_t sparsePages() const {return sparse.allocatedPages();}
+    
+    // contiguous column of one field, index i is the same entity as getOwners()[i]
+    template <auto M>
+    auto* field() {
+      constexpr size_t I = fieldIndex<M>();
+      static_assert(I < FIELDS, "Member is not part of the SoA layout!");
+      return std::get<I>(cols).data();
+    }
+    
+    const std::pmr::vector<EntID>& getOwners() const {return backlink;}
+    std::span<const EntID> owners() const override {return backlink;}
+    
+    void clear() override {
+      forColumns([](auto& col) {col.clear();});
+      backlink.clear();
+      ticks.clear();
+      sparse.clear();
+    }
+    
+    // | count | backlink | ticks | column 0 | column 1 | ... |, no hooks for SoA
+    bool save(SnapshotWriter& w) const override {
+      if constexpr (!BLOCK_COPY) return false;
+      else {
+        const uint32_t n = static_cast<uint32_t>(backlink.size());
+        w.value(n);
+        w.write(backlink.data(), n * sizeof(EntID));
+        w.write(ticks.data(), n * sizeof(ComponentTicks));
+        forColumns([&](const auto& col) {w.write(col.data(), n * sizeof(col[0]));});
+        return true;
+      }
+    }
+    
+    bool load(SnapshotReader& r) override {
+      clear();
+      if constexpr (!BLOCK_COPY) return false;
+      else {
+        const uint32_t n = r.value<uint32_t>();
+        size_t itemSize = sizeof(EntID) + sizeof(ComponentTicks);
+        forColumns([&](const auto& col) {itemSize += sizeof(col[0]);});
+        if(!r.fits(n, itemSize)) return false;
+        
+        backlink.resize(n);
+        ticks.resize(n);
+        r.read(backlink.data(), n * sizeof(EntID));
+        r.read(ticks.data(), n * sizeof(ComponentTicks));
+        forColumns([&](auto& col) {
+          col.resize(n);
+          r.read(col.data(), n * sizeof(col[0]));
+        });
+        if(!r.ok()) {
+          clear();
+          return false;
+        }
+        
+        for(uint32_t i = 0; i < n; ++i) sparse.set(entIndex(backlink[i]), static_cast<EntID>(i));
+        for(const auto& t : ticks) lastChange = std::max(lastChange, t.changed);
+        return true;
+      }
+    }
+  };
+  
+  //==========================================
+  // TAGS
+  //==========================================
+  
+  // Empty components live in the entity signature, this only keeps the packed list
+  // of owners for iteration/groups. All owners share one instance, no change ticks.
+  template <typename T>
+  class TagSet : public IComponentStor {
+    static_assert(std::is_empty_v<T>);
+    
+    SparsePages sparse;
+    std::pmr::vector<EntID> backlink;
+    
+  public:
+    static inline T instance{};
+    
+    explicit TagSet(std::pmr::memory_resource* res = std::pmr::get_default_resource())
+      : sparse(res), backlink(res) {}
+    
+    T& add(EntID e, T&&, uint32_t = 0) {
+      const uint32_t idx = entIndex(e);
+      if(EntID d = sparse.get(idx); d != NULL_ENT) {
+        backlink[d] = e;
+        return instance;
+      }
+      
+      sparse.set(idx, static_cast<EntID>(backlink.size()));
+      backlink.emplace_back(e);
+      return instance;
+    }
+    
+    void addBulk(std::span<const EntID> ents, const T&, uint32_t = 0) {
+      const size_t base = backlink.size();
+      backlink.insert(backlink.end(), ents.begin(), ents.end());
+      for(size_t i = 0; i < ents.size(); ++i) {
+        assert(sparse.get(entIndex(ents[i])) == NULL_ENT && "Entity already has the component!");
+        sparse.set(entIndex(ents[i]), static_cast<EntID>(base + i));
+      }
+    }
+    
+    void remove(EntID e) override {
+      if(!has(e)) return;
+      
+      EntID removeIdx = sparse.get(entIndex(e));
+      EntID lastE = backlink.back();
+      backlink[removeIdx] = lastE;
+      sparse.set(entIndex(lastE), removeIdx);
+      
+      backlink.pop_back();
+      sparse.reset(entIndex(e));
+    }
+    
+    T* get(EntID e) {return has(e) ? &instance : nullptr;}
+    
+    bool has(EntID e) const {
+      const EntID d = sparse.get(entIndex(e));
+      return d != NULL_ENT && backlink[d] == e;
+    }
+    
+    T& at(EntID e) {
+      assert(has(e));
+      return instance;
+    }
+    
+    T& byIndex(size_t) {return instance;}
+    
+    ComponentTicks ticksOf(EntID) const override {return {};}
+    void markChanged(EntID, uint32_t) {}
+    
+    size_t size() const {return backlink.size();}
+    
+    size_t index(EntID e) const {
+      assert(has(e));
+      return sparse.get(entIndex(e));
+    }
+    
+    void swapSlots(size_t a, size_t b) {
+      if(a == b) return;
+      std::swap(backlink[a], backlink[b]);
+      sparse.set(entIndex(backlink[a]), static_cast<EntID>(a));
+      sparse.set(entIndex(backlink[b]), static_cast<EntID>(b));
+    }
+    
+    size_t sparsePages() const {return sparse.allocatedPages();}
+    
+    const std::pmr::vector<EntID>& getOwners() const {return backlink;}
+    std::span<const EntID> owners() const override {return backlink;}
+    
+    void clear() override {
+      backlink.clear();
+      sparse.clear();
+    }
+    
+    // | count | backlink |
+    bool save(SnapshotWriter& w) const override {
+      const uint32_t n = static_cast<uint32_t>(backlink.size());
+      w.value(n);
+      w.write(backlink.data(), n * sizeof(EntID));
+      return true;
+    }
+    
+    bool load(SnapshotReader& r) override {
+      clear();
+      const uint32_t n = r.value<uint32_t>();
+      if(!r.fits(n, sizeof(EntID))) return false;
+      backlink.resize(n);
+      if(!r.read(backlink.data(), n * sizeof(EntID))) {
+        clear();
+        return false;
+      }
+      
+      for(uint32_t i = 0; i < n; ++i) sparse.set(entIndex(backlink[i]), static_cast<EntID>(i));
+      return true;
+    }
+  };
+  
+  template <typename T>
+  using Storage = std::conditional_t<std::is_empty_v<T>, TagSet<T>,
+    std::conditional_t<SoAComponent<T>, SoASparseSet<T>, SparseSet<T>>>;
+  
+  // T& for plain storages, SoALayout<T>::Ref / SoAPtr<T> for SoA ones
+  template <typename T>
+  using ComponentRef = decltype(std::declval<Storage<T>&>().byIndex(0));
+  template <typename T>
+  using ComponentPtr = decltype(std::declval<Storage<T>&>().get(0));
+  
+  // items of T per cache line boundary, for SoA the coarsest over all columns
+  template <typename T>
+  constexpr size_t lineItems() {
+    if constexpr (SoAComponent<T>) {
+      return std::apply([](auto... m) {
+        size_t items = 1;
+        ((items = std::lcm(items, CACHE_LINE / std::gcd(CACHE_LINE, sizeof(typename MemberType<decltype(m)>::type)))), ...);
+        return items;
+      }, SoALayout<T>::fields);
+    }
+    else return CACHE_LINE / std::gcd(CACHE_LINE, sizeof(T));
+  }
+  
+  //==========================================
+  // PROFILING
+  //==========================================
+  
+  // Per thread tallies, Manager takes the difference around each system run.
+  // touched: entities walked through queries, groups' each() and parallelFor,
+  // raw loops over storages aren't seen. ops: structural changes, direct or recorded.
+  struct ProfileCounters {
+    uint32_t touched = 0;
+    uint32_t ops = 0;
+  };
+  inline thread_local ProfileCounters profileCounters;
+  
+  struct SystemStats {
+    std::string_view name;
+    size_t runs = 0; // samples in the window
+    float minMs = 0.f;
+    float avgMs = 0.f;
+    float p95Ms = 0.f;
+    float p99Ms = 0.f;
+    float maxMs = 0.f;
+    float avgTouched = 0.f;
+    float avgOps = 0.f;
+  };
+  
+  // ring buffer of the last FRAMES runs of one system
+  class SystemProfile {
+  public:
+    static constexpr size_t FRAMES = 256;
+    
+  private:
+    std::array<float, FRAMES> ms{};
+    std::array<uint32_t, FRAMES> touched{};
+    std::array<uint32_t, FRAMES> ops{};
+    size_t head = 0;
+    size_t cnt = 0;
+    
+  public:
+    std::string name;
+    
+    void push(float t, uint32_t ents, uint32_t changes) {
+      ms[head] = t;
+      touched[head] = ents;
+      ops[head] = changes;
+      head = (head + 1) % FRAMES;
+      cnt = std::min(cnt + 1, FRAMES);
+    }
+    
+    SystemStats stats() const {
+      SystemStats st{.name = name, .runs = cnt};
+      if(cnt == 0) return st;
+      
+      std::array<float, FRAMES> sorted;
+      std::copy_n(ms.begin(), cnt, sorted.begin());
+      std::sort(sorted.begin(), sorted.begin() + cnt);
+      // nearest rank
+      auto rank = [&](float p) {return sorted[std::max<size_t>(1, static_cast<size_t>(std::ceil(p * cnt))) - 1];};
+      
+      st.minMs = sorted[0];
+      st.maxMs = sorted[cnt - 1];
+      st.p95Ms = rank(0.95f);
+      st.p99Ms = rank(0.99f);
+      st.avgMs = std::accumulate(sorted.begin(), sorted.begin() + cnt, 0.f) / cnt;
+      st.avgTouched = std::accumulate(touched.begin(), touched.begin() + cnt, 0.f) / cnt;
+      st.avgOps = std::accumulate(ops.begin(), ops.begin() + cnt, 0.f) / cnt;
+      return st;
+    }
+  };
+  
+  template <typename T>
+  std::string typeName() {
+    const char* raw = typeid(T).name();
+  #if __has_include(<cxxabi.h>)
+    int status = 0;
+    std::unique_ptr<char, void (*)(void*)> demangled(abi::__cxa_demangle(raw, nullptr, nullptr, &status), std::free);
+    if(status == 0 && demangled) return demangled.get();
+  #endif
+    return raw;
+  }
+  
+  //==========================================
+  // QUERIES
+  //==========================================
+  
+  // Iterates entities owning every Ts. The smallest storage drives the loop,
+  // the rest is filtered by signature, so no per-component null checks.
+  // added<T>(since) / changed<T>(since) narrow it further by change ticks.
+  // Don't add/remove Ts while iterating.
+  template <typename... Ts>
+  class Query {
+    static_assert(sizeof...(Ts) > 0, "Query needs at least one component");
+    
+    struct TickFilter {
+      const IComponentStor* stor;
+      uint32_t since;
+      bool addedOnly;
+    };
+    static constexpr size_t MAX_FILTERS = 4;
+    
+    std::tuple<Storage<Ts>*...> stors;
+    const std::vector<Signature>* signatures = nullptr;
+    const std::pmr::vector<EntID>* driver = nullptr;
+    size_t driverIdx = 0;
+    Signature mask;
+    Signature test; // mask + disabled bit
+    std::array<TickFilter, MAX_FILTERS> filters{};
+    size_t filterCnt = 0;
+    
+    bool matches(EntID e) const {
+      if(((*signatures)[entIndex(e)] & test) != mask) return false;
+      
+      for(size_t k = 0; k < filterCnt; ++k) {
+        const ComponentTicks t = filters[k].stor->ticksOf(e);
+        if((filters[k].addedOnly ? t.added : t.changed) <= filters[k].since) return false;
+      }
+      return true;
+    }
+    
+    template <typename T>
+    Query withFilter(uint32_t since, bool addedOnly) const {
+      assert(filterCnt < MAX_FILTERS && "Too many tick filters!");
+      Query q = *this;
+      q.filters[q.filterCnt++] = {std::get<Storage<T>*>(stors), since, addedOnly};
+      return q;
+    }
+    
+    // component from the driving storage is read by dense index, others by sparse
+    template <size_t I>
+    decltype(auto) fetch(EntID e, size_t i) {
+      auto* stor = std::get<I>(stors);
+      return I == driverIdx ? stor->byIndex(i) : stor->at(e);
+    }
+    
+    template <size_t... Is>
+    std::tuple<EntID, ComponentRef<Ts>...> make(EntID e, size_t i, std::index_sequence<Is...>) {
+      return {e, fetch<Is>(e, i)...};
+    }
+    
+  public:
+    class Iterator {
+      Query* q;
+      size_t i;
+      
+      void skip() {
+        while(i < q->driver->size() && !q->matches((*q->driver)[i])) ++i;
+      }
+      
+    public:
+      Iterator(Query* query, size_t idx) : q(query), i(idx) {skip();}
+      
+      std::tuple<EntID, ComponentRef<Ts>...> operator*() const {
+        return q->make((*q->driver)[i], i, std::index_sequence_for<Ts...>{});
+      }
+      Iterator& operator++() {
+        ++i;
+        skip();
+        return *this;
+      }
+      bool operator==(const Iterator& o) const {return i == o.i;}
+    };
+    
+    Query(const std::vector<Signature>& sigs, Storage<Ts>&... s)
+      : stors(&s...), signatures(&sigs) {
+      (mask.set(getComponentID<Ts>()), ...);
+      test = enabledTest(mask);
+      
+      size_t sizes[] = {s.size()...};
+      const std::pmr::vector<EntID>* owners[] = {&s.getOwners()...};
+      for(size_t k = 0; k < sizeof...(Ts); ++k) {
+        if(sizes[k] < sizes[driverIdx]) driverIdx = k;
+      }
+      driver = owners[driverIdx];
+    }
+    
+    Iterator begin() {
+      profileCounters.touched += static_cast<uint32_t>(driver->size());
+      return {this, 0};
+    }
+    Iterator end() {return {this, driver->size()};}
+    
+    // f(EntID, Ts&...)
+    template <typename F>
+    void each(F&& f) {
+      profileCounters.touched += static_cast<uint32_t>(driver->size());
+      for(size_t i = 0; i < driver->size(); ++i) {
+        EntID e = (*driver)[i];
+        if(!matches(e)) continue;
+        std::apply(f, make(e, i, std::index_sequence_for<Ts...>{}));
+      }
+    }
+    
+    size_t sizeHint() const {return driver->size();}
+    
+    // only T added after tick since
+    template <typename T>
+    Query added(uint32_t since) const {return withFilter<T>(since, true);}
+    
+    // only T added or marked changed after tick since
+    template <typename T>
+    Query changed(uint32_t since) const {return withFilter<T>(since, false);}
+  };
+  
+  //==========================================
+  // GROUPS
+  //==========================================
+  
+  struct IGroup {
+    virtual ~IGroup() = default;
+    virtual void onAdd(EntID e) = 0; // after an owned component was added
+    virtual void onRemove(EntID e) = 0; // before an owned component is removed
+    virtual void rebuild() = 0; // after the owned storages were replaced wholesale
+  };
+  
+  // Owning group: entities having all Ts are packed into [0, size()) of every
+  // owned storage in the same order, so index i is the same entity everywhere.
+  // A storage can be owned by one group only.
+  template <typename... Ts>
+  class Group : public IGroup {
+    using First = std::tuple_element_t<0, std::tuple<Ts...>>;
+    
+    std::tuple<Storage<Ts>*...> stors;
+    const std::vector<Signature>* signatures = nullptr;
+    Signature mask;
+    Signature test;
+    size_t len = 0;
+    
+    // disabled entities are kept out of the packed range
+    bool matches(EntID e) const {
+      return ((*signatures)[entIndex(e)] & test) == mask;
+    }
+    
+  public:
+    Group(const std::vector<Signature>& sigs, Storage<Ts>&... s)
+      : stors(&s...), signatures(&sigs) {
+      (mask.set(getComponentID<Ts>()), ...);
+      test = enabledTest(mask);
+      rebuild(); // pull in entities that already match
+    }
+    
+    void rebuild() override {
+      len = 0;
+      size_t sizes[] = {std::get<Storage<Ts>*>(stors)->size()...};
+      const std::pmr::vector<EntID>* owners[] = {&std::get<Storage<Ts>*>(stors)->getOwners()...};
+      size_t smallest = 0;
+      for(size_t k = 0; k < sizeof...(Ts); ++k) {
+        if(sizes[k] < sizes[smallest]) smallest = k;
+      }
+      const std::vector<EntID> candidates(owners[smallest]->begin(), owners[smallest]->end());
+      for(EntID e : candidates) onAdd(e);
+    }
+    
+    void onAdd(EntID e) override {
+      if(!matches(e) || std::get<0>(stors)->index(e) < len) return;
+      
+      (std::get<Storage<Ts>*>(stors)->swapSlots(std::get<Storage<Ts>*>(stors)->index(e), len), ...);
+      ++len;
+    }
+    
+    void onRemove(EntID e) override {
+      if(!matches(e) || std::get<0>(stors)->index(e) >= len) return;
+      
+      --len;
+      (std::get<Storage<Ts>*>(stors)->swapSlots(std::get<Storage<Ts>*>(stors)->index(e), len), ...);
+    }
+    
+    size_t size() const {return len;}
+    
+    // new slot i takes old slot order[i] in every owned storage, order.size() == size()
+    void reorder(std::span<const uint32_t> order) {
+      assert(order.size() == len);
+      applyOrder(order, [this](size_t a, size_t b) {
+        (std::get<Storage<Ts>*>(stors)->swapSlots(a, b), ...);
+      });
+    }
+    
+    // sorts the packed range, cmp gets two T& (SoA Refs) of the owned storage T
+    template <typename T, typename Cmp>
+    void sortBy(Cmp&& cmp) {
+      auto* stor = std::get<Storage<T>*>(stors);
+      std::vector<uint32_t> order(len);
+      std::iota(order.begin(), order.end(), 0u);
+      std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {return cmp(stor->byIndex(a), stor->byIndex(b));});
+      reorder(order);
+    }
+    
+    const EntID* entities() const {return std::get<0>(stors)->getOwners().data();}
+    
+    // SoA components have no T array, use field<&T::member>() on their storage
+    template <typename T>
+    T* data() {
+      static_assert(!SoAComponent<T>, "SoA storage has no T array, use view<T>().field<>()");
+      return std::get<SparseSet<T>*>(stors)->getDense().data();
+    }
+    
+    // f(EntID, Ts&...)
+    template <typename F>
+    void each(F&& f) {
+      profileCounters.touched += static_cast<uint32_t>(len);
+      const EntID* ents = entities();
+      for(size_t i = 0; i < len; ++i) {
+        f(ents[i], std::get<Storage<Ts>*>(stors)->byIndex(i)...);
+      }
+    }
+  };
+  
+  //==========================================
+  // CACHED QUERIES
+  //==========================================
+  
+  // Persistent list of enabled entities matching mask, kept current by the Manager on
+  // every signature change instead of being re-derived per iteration
+  struct QueryCache {
+    Signature mask;
+    Signature test;
+    
+    bool matches(const Signature& sig) const {return (sig & test) == mask;}
+    
+    std::vector<EntID> ents;
+    SparsePages slots; // entity index -> position in ents
+    
+    bool contains(EntID e) const {
+      const EntID p = slots.get(entIndex(e));
+      return p != NULL_ENT && ents[p] == e;
+    }
+    
+    void insert(EntID e) {
+      if(contains(e)) return;
+      slots.set(entIndex(e), static_cast<EntID>(ents.size()));
+      ents.emplace_back(e);
+    }
+    
+    void erase(EntID e) {
+      if(!contains(e)) return;
+      const EntID p = slots.get(entIndex(e));
+      const EntID last = ents.back();
+      ents[p] = last;
+      slots.set(entIndex(last), p);
+      ents.pop_back();
+      slots.reset(entIndex(e));
+    }
+    
+    void clear() {
+      ents.clear();
+      slots.clear();
+    }
+  };
+  
+  // Typed view of a QueryCache, components are fetched by sparse lookup only, every
+  // listed entity is known to match. Don't add/remove Ts while iterating.
+  template <typename... Ts>
+  class CachedQuery {
+    const QueryCache* cache;
+    std::tuple<Storage<Ts>*...> stors;
+    
+    std::tuple<EntID, ComponentRef<Ts>...> make(EntID e) {
+      return {e, std::get<Storage<Ts>*>(stors)->at(e)...};
+    }
+    
+  public:
+    class Iterator {
+      CachedQuery* q;
+      size_t i;
+      
+    public:
+      Iterator(CachedQuery* query, size_t idx) : q(query), i(idx) {}
+      
+      std::tuple<EntID, ComponentRef<Ts>...> operator*() const {return q->make(q->cache->ents[i]);}
+      Iterator& operator++() {
+        ++i;
+        return *this;
+      }
+      bool operator==(const Iterator& o) const {return i == o.i;}
+    };
+    
+    CachedQuery(const QueryCache& c, Storage<Ts>&... s) : cache(&c), stors(&s...) {}
+    
+    Iterator begin() {
+      profileCounters.touched += static_cast<uint32_t>(cache->ents.size());
+      return {this, 0};
+    }
+    Iterator end() {return {this, cache->ents.size()};}
+    
+    // f(EntID, Ts&...)
+    template <typename F>
+    void each(F&& f) {
+      profileCounters.touched += static_cast<uint32_t>(cache->ents.size());
+      for(EntID e : cache->ents) std::apply(f, make(e));
+    }
+    
+    size_t size() const {return cache->ents.size();}
+    const std::vector<EntID>& entities() const {return cache->ents;}
+  };
+  
+  //==========================================
+  // COMMANDS
+  //==========================================
+  
+  // Deferred structural changes. Can be recorded from several threads, applied by
+  // Manager::flush() at sync points in batches: creates, adds (by type, sorted by
+  // entity), removes (by type, sorted by entity), destroys.
+  class CommandBuffer {
+  public:
+    // entity created by this buffer, gets a real id on flush
+    struct Pending { uint32_t slot; };
+    
+  private:
+    friend class Manager;
+    
+    struct IAddStream {
+      virtual ~IAddStream() = default;
+      virtual size_t apply(Manager& m, const std::vector<EntID>& created) = 0;
+    };
+    
+    template <typename T>
+    struct AddStream : IAddStream {
+      std::vector<std::pair<EntID, T>> adds;
+      std::vector<std::pair<uint32_t, T>> pendingAdds;
+      
+      size_t apply(Manager& m, const std::vector<EntID>& created) override;
+    };
+    
+    std::mutex mtx;
+    uint32_t createCnt = 0;
+    std::vector<std::unique_ptr<IAddStream>> addStreams; // by TypeID
+    std::vector<std::pair<TypeID, EntID>> removes;
+    std::vector<EntID> destroys;
+    bool dirty = false;
+    
+    template <typename T>
+    AddStream<T>& stream() {
+      TypeID id = getComponentID<T>();
+      if(addStreams.size() <= id) {
+        addStreams.resize(id + 1);
+      }
+      if(!addStreams[id]) {
+        addStreams[id] = std::make_unique<AddStream<T>>();
+      }
+      return *static_cast<AddStream<T>*>(addStreams[id].get());
+    }
+    
+  public:
+    Pending create() {
+      std::lock_guard lock(mtx);
+      dirty = true;
+      ++profileCounters.ops;
+      return {createCnt++};
+    }
+    
+    void destroy(EntID e) {
+      std::lock_guard lock(mtx);
+      dirty = true;
+      ++profileCounters.ops;
+      destroys.emplace_back(e);
+    }
+    
+    template <typename T>
+    void add(EntID e, T&& comp) {
+      std::lock_guard lock(mtx);
+      dirty = true;
+      ++profileCounters.ops;
+      stream<T>().adds.emplace_back(e, std::move(comp));
+    }
+    
+    template <typename T>
+    void add(Pending p, T&& comp) {
+      std::lock_guard lock(mtx);
+      dirty = true;
+      ++profileCounters.ops;
+      stream<T>().pendingAdds.emplace_back(p.slot, std::move(comp));
+    }
+    
+    template <typename T>
+    void remove(EntID e) {
+      std::lock_guard lock(mtx);
+      dirty = true;
+      ++profileCounters.ops;
+      removes.emplace_back(getComponentID<T>(), e);
+    }
+    
+    bool empty() const {return !dirty;}
+  };
+  
+  //==========================================
+  // PREFABS
+  //==========================================
+  
+  // Component set recorded once and stamped onto new entities by Manager::instantiate(),
+  // which appends to every storage in bulk instead of per entity and component
+  class Prefab {
+    friend class Manager;
+    
+    struct IEntry {
+      virtual ~IEntry() = default;
+      virtual void apply(Manager& m, std::span<const EntID> ents, uint32_t tick) const = 0;
+    };
+    
+    template <typename T>
+    struct Entry : IEntry {
+      T value;
+      explicit Entry(T&& v) : value(std::move(v)) {}
+      void apply(Manager& m, std::span<const EntID> ents, uint32_t tick) const override;
+    };
+    
+    std::vector<std::unique_ptr<IEntry>> entries;
+    std::vector<TypeID> ids; // parallel to entries
+    Signature mask;
+    
+  public:
+    // adding a type again replaces its value
+    template <typename T>
+    Prefab& add(T&& comp) {
+      using C = std::remove_cvref_t<T>;
+      const TypeID id = getComponentID<C>();
+      auto entry = std::make_unique<Entry<C>>(C(std::forward<T>(comp)));
+      
+      if(mask.test(id)) {
+        entries[std::find(ids.begin(), ids.end(), id) - ids.begin()] = std::move(entry);
+      }
+      else {
+        mask.set(id);
+        ids.emplace_back(id);
+        entries.emplace_back(std::move(entry));
+      }
+      return *this;
+    }
+    
+    const Signature& signature() const {return mask;}
+  };
+  
+  //==========================================
+  // FRAME MEMORY
+  //==========================================
+  
+  // Scratch memory of one frame: bump allocation out of one buffer, all of it is dropped
+  // by reset(). Locked, so systems of a parallel stage can share it. A frame that
+  // overflows the buffer spills to upstream and the next reset() grows the buffer to
+  // that peak, steady state frames don't touch upstream.
+  class FrameArena : public std::pmr::memory_resource {
+    std::pmr::memory_resource* upstream;
+    std::byte* buf = nullptr;
+    size_t cap = 0;
+    size_t used = 0; // requested this frame, alignment included
+    std::optional<std::pmr::monotonic_buffer_resource> arena;
+    std::mutex mtx;
+    
+    void grow(size_t newCap) {
+      arena.reset();
+      if(buf) upstream->deallocate(buf, cap, alignof(std::max_align_t));
+      cap = newCap;
+      buf = static_cast<std::byte*>(upstream->allocate(cap, alignof(std::max_align_t)));
+      arena.emplace(buf, cap, upstream);
+    }
+    
+    void* do_allocate(size_t bytes, size_t align) override {
+      std::lock_guard lock(mtx);
+      used += bytes + align;
+      return arena->allocate(bytes, align);
+    }
+    void do_deallocate(void*, size_t, size_t) override {} // everything goes at reset()
+    bool do_is_equal(const std::pmr::memory_resource& o) const noexcept override {return this == &o;}
+    
+  public:
+    explicit FrameArena(size_t capacity = 1 << 20, std::pmr::memory_resource* up = std::pmr::get_default_resource())
+      : upstream(up) {
+      grow(capacity);
+    }
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+    ~FrameArena() override {
+      arena.reset();
+      upstream->deallocate(buf, cap, alignof(std::max_align_t));
+    }
+    
+    // nothing allocated from it may be used afterwards
+    void reset() {
+      std::lock_guard lock(mtx);
+      if(used > cap) grow(used + used / 2);
+      else arena->release();
+      used = 0;
+    }
+    
+    size_t capacity() const {return cap;}
+  };
+  
+  //==========================================
+  // MANAGER
+  //==========================================
+  
+  class Manager {
+    using RunCondition = bool (*)(Manager&);
+    
+    struct SystemNode {
+      std::unique_ptr<ISystem> sys;
+      Access access;
+      RunCondition runIf = nullptr;
+      SystemProfile prof;
+    };
+    
+    struct IStorageBlock {
+      virtual ~IStorageBlock() = default;
+    };
+    
+    template <typename... Cs>
+    struct StorageBlock : IStorageBlock {
+      std::tuple<Storage<Cs>...> stors;
+      explicit StorageBlock(std::pmr::memory_resource* res) : stors(((void)sizeof(Cs), res)...) {}
+    };
+    
+    std::pmr::memory_resource* memRes; // component storages allocate from it
+    FrameArena frameArena;
+    
+    std::vector<std::unique_ptr<IComponentStor>> storsOwnership;
+    std::vector<std::unique_ptr<IStorageBlock>> storBlocks;
+    std::vector<IComponentStor*> storsID;
+    std::vector<Signature> signatures;
+    std::vector<SystemNode> systems;
+    std::vector<std::vector<size_t>> stages; // systems of a stage don't conflict
+    bool stagesDirty = true;
+    ThreadPool* pool = nullptr;
+    JobGraph frameGraph; // stages as nodes, a flush node between them
+    std::vector<uint8_t> willRun; // by system, run conditions of the current frame
+    float frameDt = 0.f;
+    std::vector<std::unique_ptr<IGroup>> groups;
+    std::vector<IGroup*> groupOf; // by TypeID, owning group of the storage
+    std::vector<std::unique_ptr<QueryCache>> queryCaches;
+    std::vector<std::vector<QueryCache*>> cachesOf; // by TypeID, caches whose mask has it
+    
+    std::vector<std::unique_ptr<IResource>> resources; // by resource id
+    
+    std::unordered_map<std::type_index, std::unique_ptr<IAssetStor>> assets;
+    std::unordered_map<std::type_index, std::function<rawHandle(const std::string&)>> assetLoaders;
+    
+    std::vector<EntID> entities; // by index, current versioned id of the slot
+    std::vector<uint32_t> freeInds;
+    
+    CommandBuffer cmds;
+    std::vector<EntID> cmdCreated; // scratch for flush()
+    
+    // bumped per system run and per stage sync; wraps after ~4e9 runs
+    std::atomic<uint32_t> changeTick{1};
+    static inline thread_local uint32_t runTick = 0; // tick of the system running on this thread
+    
+  public:
+    
+    explicit Manager(std::pmr::memory_resource* res = std::pmr::get_default_resource()) : memRes(res) {}
+    
+    // temporaries of the running frame, released at the end of update()
+    std::pmr::memory_resource* frameMemory() {return &frameArena;}
+    
+    EntID createEntity() {
+      ++profileCounters.ops;
+      EntID id;
+      if(!freeInds.empty()) {
+        id = entities[freeInds.back()];
+        freeInds.pop_back();
+      }
+      else {
+        const uint32_t idx = static_cast<uint32_t>(entities.size());
+        assert(idx < ENT_INDEX_MASK && "Entity index space exhausted!");
+        id = makeEnt(idx, 0);
+        entities.emplace_back(id);
+      }
+      
+      const uint32_t idx = entIndex(id);
+      if(signatures.size() <= idx) {
+        signatures.resize(idx + 13);
+      }
+      signatures[idx].reset();
+      
+      return id;
+    }
+    
+    bool isAlive(EntID e) const {
+      const uint32_t idx = entIndex(e);
+      return e != NULL_ENT && idx < entities.size() && entities[idx] == e;
+    }
+    
+    size_t aliveCount() const {return entities.size() - freeInds.size();}
+    
+    // count new entities with the prefab's components, every storage is appended once;
+    // tweak per entity values afterwards
+    std::vector<EntID> instantiate(const Prefab& prefab, size_t count) {
+      std::vector<EntID> ents;
+      ents.reserve(count);
+      for(size_t i = 0; i < count; ++i) {
+        const EntID e = createEntity();
+        signatures[entIndex(e)] = prefab.mask;
+        ents.emplace_back(e);
+      }
+      
+      const uint32_t tick = currentTick();
+      for(const auto& entry : prefab.entries) entry->apply(*this, ents, tick);
+      
+      for(size_t k = 0; k < prefab.ids.size(); ++k) {
+        IGroup* g = groupOf[prefab.ids[k]];
+        // a group owns several storages, notify it once
+        if(!g || std::any_of(prefab.ids.begin(), prefab.ids.begin() + k, [&](TypeID id) {return groupOf[id] == g;})) continue;
+        for(EntID e : ents) g->onAdd(e);
+      }
+      for(auto& cache : queryCaches) {
+        if(!cache->matches(prefab.mask)) continue;
+        for(EntID e : ents) cache->insert(e);
+      }
+      
+      return ents;
+    }
+    
+    EntID instantiate(const Prefab& prefab) {return instantiate(prefab, 1).front();}
+    
+    void destroyEntity(EntID e) {
+      const uint32_t idx = entIndex(e);
+      if(e == NULL_ENT || idx >= entities.size() || entities[idx] != e) return; // stale or already destroyed
+      ++profileCounters.ops;
+      
+      Signature& mask = signatures[idx];
+      
+      // groups have to release the entity while all its owned components are still there
+      for(size_t i = 0; i < groupOf.size(); ++i) {
+        if(groupOf[i] && mask.test(i)) {
+          groupOf[i]->onRemove(e);
+        }
+      }
+      
+      for(auto& cache : queryCaches) {
+        if((mask & cache->mask) == cache->mask) cache->erase(e);
+      }
+      
+      for(size_t i = 0; i < storsID.size(); ++i) {
+        if(mask.test(i)) {
+          storsID[i]->remove(e);
+        }
+      }
+      mask.reset();
+      
+      // next owner of the slot gets a new generation, NULL_ENT is never produced
+      uint32_t gen = (entGen(e) + 1) & ENT_GEN_MASK;
+      if(makeEnt(idx, gen) == NULL_ENT) gen = 0;
+      entities[idx] = makeEnt(idx, gen);
+      freeInds.emplace_back(idx);
+    }
+    
+    const Signature& getSignature(EntID e) {
+      return signatures[entIndex(e)];
+    }
+    
+    // A disabled entity keeps its components but queries, cached queries and groups
+    // skip it: it leaves their packed lists/ranges, so iteration doesn't pay for it.
+    // Direct access (getComponent, view) still works. Structural, like addComponent.
+    void disable(EntID e) {
+      if(!isAlive(e)) return;
+      Signature& sig = signatures[entIndex(e)];
+      if(sig.test(DISABLED_BIT)) return;
+      ++profileCounters.ops;
+      
+      for(size_t i = 0; i < groupOf.size(); ++i) {
+        if(groupOf[i] && sig.test(i)) groupOf[i]->onRemove(e);
+      }
+      for(auto& cache : queryCaches) {
+        if(cache->matches(sig)) cache->erase(e);
+      }
+      sig.set(DISABLED_BIT);
+    }
+    
+    // like disable() it swaps grouped components around, pointers to them are stale after
+    void enable(EntID e) {
+      if(!isAlive(e)) return;
+      Signature& sig = signatures[entIndex(e)];
+      if(!sig.test(DISABLED_BIT)) return;
+      ++profileCounters.ops;
+      
+      sig.reset(DISABLED_BIT);
+      for(size_t i = 0; i < groupOf.size(); ++i) {
+        if(groupOf[i] && sig.test(i)) groupOf[i]->onAdd(e);
+      }
+      for(auto& cache : queryCaches) {
+        if(cache->matches(sig)) cache->insert(e);
+      }
+    }
+    
+    bool isEnabled(EntID e) const {
+      return isAlive(e) && !signatures[entIndex(e)].test(DISABLED_BIT);
+    }
+    
+    //==========================================
+    // COMPONENT MANAGEMENT
+    //==========================================
+    
+    template <typename T>
+    void registerComponent() {
+      auto newStor = std::make_unique<Storage<T>>(memRes);
+      bindStorage(getComponentID<T>(), newStor.get());
+      storsOwnership.emplace_back(std::move(newStor));
+    }
+    
+    // whole list at once, storages live in one fixed tuple instead of separate allocations
+    template <typename... Cs>
+    void registerComponents(TypeList<Cs...>) {
+      auto block = std::make_unique<StorageBlock<Cs...>>(memRes);
+      (bindStorage(getComponentID<Cs>(), &std::get<Storage<Cs>>(block->stors)), ...);
+      storBlocks.emplace_back(std::move(block));
+    }
+    
+    template <typename T>
+    ComponentRef<T> addComponent(EntID e, T&& comp) {
+      TypeID id = getComponentID<T>();
+      
+      assert(id < storsID.size() && storsID[id] && "Component not registered before use!");
+      
+      assert(entities[entIndex(e)] == e && "Adding component to a destroyed entity!");
+      ++profileCounters.ops;
+      
+      Signature& sig = signatures[entIndex(e)];
+      if(!sig.test(id)) {
+        sig.set(id, true);
+        for(QueryCache* cache : cachesOf[id]) {
+          if(cache->matches(sig)) cache->insert(e);
+        }
+      }
+      
+      auto* stor = static_cast<Storage<T>*>(storsID[id]);
+      ComponentRef<T> res = stor->add(e, std::move(comp), currentTick());
+      if(groupOf[id]) {
+        groupOf[id]->onAdd(e);
+        return stor->at(e);
+      }
+      
+      return res;
+    }
+    
+    template <typename T>
+    void removeComponent(EntID e) {
+      removeComponent(getComponentID<T>(), e);
+    }
+    
+    void removeComponent(TypeID id, EntID e) {
+      if(!isAlive(e) || !signatures[entIndex(e)].test(id)) return;
+      ++profileCounters.ops;
+      
+      if(groupOf[id]) {
+        groupOf[id]->onRemove(e);
+      }
+      for(QueryCache* cache : cachesOf[id]) cache->erase(e);
+      signatures[entIndex(e)].set(id, false);
+      storsID[id]->remove(e);
+    }
+    
+    template <typename T>
+    ComponentPtr<T> getComponent(EntID e) {
+      TypeID id = getComponentID<T>();
+      if(!signatures[entIndex(e)].test(id)) return nullptr;
+      
+      if constexpr (std::is_empty_v<T>) return isAlive(e) ? &TagSet<T>::instance : nullptr;
+      else return static_cast<Storage<T>*>(storsID[id])->get(e);
+    }
+    
+    // signature bit test, no storage lookup
+    template <typename T>
+    bool hasComponent(EntID e) const {
+      const uint32_t idx = entIndex(e);
+      return idx < signatures.size() && signatures[idx].test(getComponentID<T>()) && isAlive(e);
+    }
+    
+    //==========================================
+    // CHANGE TICKS
+    //==========================================
+    
+    // tick stamped on writes right now: the running system's own tick inside update(),
+    // the latest one outside. A system never sees its own changes on its next run.
+    uint32_t currentTick() const {
+      return runTick ? runTick : changeTick.load(std::memory_order_relaxed);
+    }
+    
+    // plain writes through get/query aren't tracked, mark them for change filters
+    template <typename T>
+    void markChanged(EntID e) {
+      view<T>().markChanged(e, currentTick());
+    }
+    
+    template <typename T>
+    bool isAdded(EntID e, uint32_t since) {
+      return view<T>().ticksOf(e).added > since;
+    }
+    
+    // added counts as changed
+    template <typename T>
+    bool isChanged(EntID e, uint32_t since) {
+      return view<T>().ticksOf(e).changed > since;
+    }
+    
+    template <typename T>
+    Storage<T>& view() {
+      auto typeId = getComponentID<T>();
+      assert(typeId < storsID.size() && storsID[typeId]);
+      return *static_cast<Storage<T>*>(storsID[typeId]);
+    }
+    
+    template <typename... Ts>
+    Query<Ts...> query() {
+      return Query<Ts...>(signatures, view<Ts>()...);
+    }
+    
+    // Reorders T's dense array (and its sparse map), see SparseSet::sortBy.
+    // Not for storages owned by a group, that would break the packing; use Group::sortBy.
+    template <typename T, typename Cmp>
+    void sortBy(Cmp&& cmp) {
+      static_assert(!std::is_empty_v<T>, "Tags have no data to sort by");
+      assert(!groupOf[getComponentID<T>()] && "Storage is owned by a group, sort the group!");
+      view<T>().sortBy(std::forward<Cmp>(cmp));
+    }
+    
+    // Setup time: creates the persistent match list of Ts (any order, same set = same cache).
+    // Cost moves to add/remove/destroy of Ts, iteration only walks matches.
+    template <typename... Ts>
+    void registerQuery() {
+      static_assert(sizeof...(Ts) > 0, "Query needs at least one component");
+      const Signature mask = maskOf(TypeList<Ts...>{});
+      if(findCache(mask)) return;
+      
+      auto cache = std::make_unique<QueryCache>();
+      cache->mask = mask;
+      cache->test = enabledTest(mask);
+      for(TypeID id : {getComponentID<Ts>()...}) {
+        assert(id < storsID.size() && storsID[id] && "Component not registered before use!");
+        cachesOf[id].emplace_back(cache.get());
+      }
+      fillCache(*cache);
+      queryCaches.emplace_back(std::move(cache));
+    }
+    
+    // registered with registerQuery<Ts...>() beforehand, lookup only so systems can call it in parallel
+    template <typename... Ts>
+    CachedQuery<Ts...> cachedQuery() {
+      const QueryCache* cache = findCache(maskOf(TypeList<Ts...>{}));
+      assert(cache && "Query not registered before use!");
+      return CachedQuery<Ts...>(*cache, view<Ts>()...);
+    }
+    
+    // creates the owning group on first call, later calls must use the same Ts order
+    template <typename... Ts>
+    Group<Ts...>& group() {
+      TypeID ids[] = {getComponentID<Ts>()...};
+      
+      if(IGroup* existing = groupOf[ids[0]]) {
+        assert(dynamic_cast<Group<Ts...>*>(existing) && "Storage is already owned by another group!");
+        return *static_cast<Group<Ts...>*>(existing);
+      }
+      
+      for(TypeID id : ids) {
+        assert(id < storsID.size() && storsID[id] && "Component not registered before use!");
+        assert(!groupOf[id] && "Storage is already owned by another group!");
+      }
+      
+      auto g = std::make_unique<Group<Ts...>>(signatures, view<Ts>()...);
+      Group<Ts...>* ptr = g.get();
+      for(TypeID id : ids) groupOf[id] = ptr;
+      groups.emplace_back(std::move(g));
+      
+      return *ptr;
+    }
+    
+    //==========================================
+    // RESOURCES
+    //==========================================
+    
+    // creates or replaces the T resource
+    template <typename T, typename... Args>
+    T& setResource(Args&&... args) {
+      const uint32_t id = getResourceID<T>();
+      if(resources.size() <= id) {
+        resources.resize(id + 1);
+      }
+      resources[id] = std::make_unique<Resource<T>>(std::forward<Args>(args)...);
+      return static_cast<Resource<T>*>(resources[id].get())->value;
+    }
+    
+    template <typename T>
+    T* tryResource() {
+      const uint32_t id = getResourceID<T>();
+      if(id >= resources.size() || !resources[id]) return nullptr;
+      return &static_cast<Resource<T>*>(resources[id].get())->value;
+    }
+    
+    // Resources aren't part of system access masks: declared systems may read them,
+    // writes belong to exclusive systems or happen between updates.
+    template <typename T>
+    T& resource() {
+      T* res = tryResource<T>();
+      assert(res && "Resource not set before use!");
+      return *res;
+    }
+    
+    //==========================================
+    // SNAPSHOTS
+    //==========================================
+    
+    static constexpr uint32_t SNAPSHOT_MAGIC = 0x50534345; // "ECSP"
+    static constexpr uint32_t SNAPSHOT_VERSION = 1;
+    
+    template <typename T>
+    void setSnapshotHook(SnapshotHook<T> hook) {
+      static_assert(!std::is_empty_v<T> && !SoAComponent<T>, "Tags and SoA components are always block copied");
+      view<T>().setSnapshotHook(std::move(hook));
+    }
+    
+    // Whole world in one buffer: entity slots, signatures, then every registered storage
+    // by TypeID. Storages that can't be saved are left out and dropped on load.
+    // Resources, systems, groups and assets aren't part of it.
+    std::vector<std::byte> saveSnapshot() const {
+      static_assert(MAX_COMPONENTS <= 64, "Signatures are stored as 64 bit masks");
+      assert(cmds.empty() && "Flush commands before taking a snapshot!");
+      
+      SnapshotWriter w;
+      w.value(SNAPSHOT_MAGIC);
+      w.value(SNAPSHOT_VERSION);
+      w.value(changeTick.load(std::memory_order_relaxed));
+      
+      const uint32_t entCnt = static_cast<uint32_t>(entities.size());
+      w.value(entCnt);
+      w.write(entities.data(), entCnt * sizeof(EntID));
+      w.value(static_cast<uint32_t>(freeInds.size()));
+      w.write(freeInds.data(), freeInds.size() * sizeof(uint32_t));
+      for(uint32_t i = 0; i < entCnt; ++i) w.value<uint64_t>(signatures[i].to_ullong());
+      
+      // | id | payload bytes | payload |, 0 bytes for skipped storages
+      w.value(static_cast<uint32_t>(std::count_if(storsID.begin(), storsID.end(), [](auto* s) {return s != nullptr;})));
+      for(TypeID id = 0; id < storsID.size(); ++id) {
+        if(!storsID[id]) continue;
+        
+        w.value(id);
+        const size_t sizeAt = w.size();
+        w.value<uint64_t>(0);
+        if(storsID[id]->save(w)) w.patch<uint64_t>(sizeAt, w.size() - sizeAt - sizeof(uint64_t));
+      }
+      
+      return w.take();
+    }
+    
+    // Replaces the whole world. Needs the same component registration (and ids) as the
+    // saving side. On error the world is left empty, on success every system gets onLoad().
+    std::expected<void, std::string_view> loadSnapshot(std::span<const std::byte> data) {
+      assert(cmds.empty() && "Flush commands before loading a snapshot!");
+      
+      SnapshotReader r(data);
+      if(r.value<uint32_t>() != SNAPSHOT_MAGIC) return std::unexpected("Not an ECS snapshot");
+      if(r.value<uint32_t>() != SNAPSHOT_VERSION) return std::unexpected("Unsupported snapshot version");
+      const uint32_t tick = r.value<uint32_t>();
+      
+      const uint32_t entCnt = r.value<uint32_t>();
+      // slot ids and signatures of every entity follow
+      if(entCnt > ENT_INDEX_MASK || !r.fits(entCnt, sizeof(EntID) + sizeof(uint64_t))) return std::unexpected("Corrupted snapshot header");
+      std::vector<EntID> ents(entCnt);
+      r.read(ents.data(), entCnt * sizeof(EntID));
+      const uint32_t freeCnt = r.value<uint32_t>();
+      if(freeCnt > entCnt || !r.fits(freeCnt, sizeof(uint32_t))) return std::unexpected("Corrupted snapshot header");
+      std::vector<uint32_t> frees(freeCnt);
+      r.read(frees.data(), freeCnt * sizeof(uint32_t));
+      std::vector<Signature> sigs(entCnt);
+      for(uint32_t i = 0; i < entCnt; ++i) sigs[i] = Signature(r.value<uint64_t>());
+      if(!r.ok()) return std::unexpected("Truncated snapshot");
+      
+      // point of no return
+      clearWorld();
+      entities = std::move(ents);
+      freeInds = std::move(frees);
+      signatures = std::move(sigs);
+      
+      Signature loaded;
+      loaded.set(DISABLED_BIT);
+      const uint32_t storCnt = r.value<uint32_t>();
+      for(uint32_t k = 0; k < storCnt && r.ok(); ++k) {
+        const TypeID id = r.value<TypeID>();
+        const uint64_t bytes = r.value<uint64_t>();
+        if(bytes == 0) continue;
+        if(id >= storsID.size() || !storsID[id]) {
+          r.skip(bytes);
+          continue;
+        }
+        const size_t before = r.remaining();
+        if(!storsID[id]->load(r) || before - r.remaining() != bytes) {
+          clearWorld();
+          return std::unexpected("Corrupted component data");
+        }
+        loaded.set(id);
+      }
+      if(!r.ok()) {
+        clearWorld();
+        return std::unexpected("Truncated snapshot");
+      }
+      
+      // components whose storage wasn't restored are gone
+      for(Signature& sig : signatures) sig &= loaded;
+      if(!loadedConsistent()) {
+        clearWorld();
+        return std::unexpected("Entities and components don't match");
+      }
+      for(auto& g : groups) g->rebuild();
+      for(auto& cache : queryCaches) fillCache(*cache);
+      
+      // restored slots keep their ticks, every system sees the world as new
+      changeTick.store(std::max(tick, changeTick.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+      for(auto& node : systems) {
+        node.sys->lastRun = 0;
+        node.sys->onLoad(*this);
+      }
+      
+      return {};
+    }
+    
+    //==========================================
+    // ASSET MANAGEMENT
+    //==========================================
+    
+    // loader API - std::expected<T, std::string> load(const std::string&)
+    template <typename T, typename L>
+    void registerAsset(L&& l) {
+      auto pool = std::make_unique<AssetPool<T>>();
+      AssetPool<T>* rawPool = pool.get();
+      assets[std::type_index(typeid(T))] = std::move(pool);
+      
+      assetLoaders[std::type_index(typeid(T))] = [rawPool, loader = std::forward<L>(l)](const std::string& path) mutable -> rawHandle {
+        if(auto existing = rawPool->find(path)) {
+          return *existing;
+        }
         
         auto result = loader.load(path);
         if(!result) {
@@ -366,7 +2306,7 @@ namespace ecs {
     }
     
     //==========================================
-    // ASSET MANAGEMENT
+    // SYSTEM MANAGEMENT
     //==========================================
     
     template <typename S, typename... Args>
@@ -375,16 +2315,389 @@ namespace ecs {
       
       auto sys = std::make_unique<S>(std::forward<Args>(args)...);
       S* ptr = sys.get();
-      systems.emplace_back(std::move(sys));
+      systems.emplace_back(SystemNode{std::move(sys), accessOf<S>(), runConditionOf<S>(), {}});
+      systems.back().prof.name = typeName<S>();
+      stagesDirty = true;
       
       return *ptr;
     }
     
+    // without a pool every system runs on the calling thread in registration order
+    void setThreadPool(ThreadPool* tp) {pool = tp;}
+    
+    // systems may declare  static bool runIf(ecs::Manager&);  it's checked on the calling
+    // thread when the system's stage starts, a skipped one isn't called at all
+    template <typename S>
+    static RunCondition runConditionOf() {
+      if constexpr (requires(Manager& m) { {S::runIf(m)} -> std::convertible_to<bool>; }) return &S::runIf;
+      else return nullptr;
+    }
+    
+    template <typename S>
+    static Access accessOf() {
+      if constexpr (requires { {S::access()} -> std::same_as<Access>; }) return S::access();
+      
+      Access a;
+      if constexpr (requires { typename S::Reads; } || requires { typename S::Writes; }) {
+        a.exclusive = false;
+        if constexpr (requires { typename S::Reads; }) a.reads = maskOf(typename S::Reads{});
+        if constexpr (requires { typename S::Writes; }) a.writes = maskOf(typename S::Writes{});
+      }
+      return a;
+    }
+    
+    template <typename... Ts>
+    static Signature maskOf(TypeList<Ts...>) {
+      Signature mask;
+      (mask.set(getComponentID<Ts>()), ...);
+      return mask;
+    }
+    
+    size_t stageCount() {
+      if(stagesDirty) buildStages();
+      return stages.size();
+    }
+    
+    //==========================================
+    // PROFILING
+    //==========================================
+    
+    // Per system over its last SystemProfile::FRAMES runs, in registration order.
+    // Read it between updates or from an exclusive system.
+    std::vector<SystemStats> profile() const {
+      std::vector<SystemStats> res;
+      res.reserve(systems.size());
+      for(const auto& node : systems) res.emplace_back(node.prof.stats());
+      return res;
+    }
+    
+    void writeProfileCSV(std::ostream& out) const {
+      out << "system,runs,min_ms,avg_ms,p95_ms,p99_ms,max_ms,avg_touched,avg_ops\n";
+      for(const SystemStats& st : profile()) {
+        out << '"' << st.name << "\"," << st.runs << ',' << st.minMs << ',' << st.avgMs << ','
+            << st.p95Ms << ',' << st.p99Ms << ',' << st.maxMs << ',' << st.avgTouched << ',' << st.avgOps << '\n';
+      }
+    }
+    
+    void writeProfileJSON(std::ostream& out) const {
+      out << "[\n";
+      const auto stats = profile();
+      for(size_t i = 0; i < stats.size(); ++i) {
+        const SystemStats& st = stats[i];
+        out << "  {\"system\": \"" << st.name << "\", \"runs\": " << st.runs
+            << ", \"min_ms\": " << st.minMs << ", \"avg_ms\": " << st.avgMs
+            << ", \"p95_ms\": " << st.p95Ms << ", \"p99_ms\": " << st.p99Ms << ", \"max_ms\": " << st.maxMs
+            << ", \"avg_touched\": " << st.avgTouched << ", \"avg_ops\": " << st.avgOps << "}"
+            << (i + 1 < stats.size() ? ",\n" : "\n");
+      }
+      out << "]\n";
+    }
+    
+    //==========================================
+    // PARALLEL ITERATION
+    //==========================================
+    
+    static constexpr size_t PARALLEL_MIN_ITEMS = 2048;
+    
+    // Runs fn(chunkBegin, chunkEnd) over [begin, end) of T's dense array(s). Chunk sizes
+    // are whole multiples of cache lines worth of T, so neighbouring chunks don't share
+    // lines. Serial without a pool or below PARALLEL_MIN_ITEMS.
+    template <typename T, typename F>
+    void parallelFor(size_t begin, size_t end, F&& fn) {
+      const size_t count = end > begin ? end - begin : 0;
+      profileCounters.touched += static_cast<uint32_t>(count);
+      if(!pool || count < PARALLEL_MIN_ITEMS) {
+        if(count > 0) fn(begin, end);
+        return;
+      }
+      
+      constexpr size_t items = lineItems<T>();
+      // a few chunks per thread to even out the load
+      size_t grain = std::max(count / ((pool->getCount() + 1) * 4), PARALLEL_MIN_ITEMS / 4);
+      grain = (grain + items - 1) / items * items;
+      
+      pool->parallel_for(count, grain, [&](size_t b, size_t e) {
+        fn(begin + b, begin + e);
+      });
+    }
+    
+    // fn(EntID, T&) (a Ref for SoA) for every T, no structural changes allowed inside
+    template <typename T, typename F>
+    void parallelEach(F&& fn) {
+      auto& set = view<T>();
+      const EntID* ents = set.getOwners().data();
+      parallelFor<T>(0, set.size(), [&](size_t b, size_t e) {
+        for(size_t i = b; i < e; ++i) fn(ents[i], set.byIndex(i));
+      });
+    }
+    
+    //==========================================
+    // DEFERRED COMMANDS
+    //==========================================
+    
+    CommandBuffer& commands() {return cmds;}
+    
+    // sync point, applies everything recorded in commands(); returns number of applied ops
+    size_t flush() {
+      if(cmds.empty()) return 0;
+      
+      std::lock_guard lock(cmds.mtx);
+      size_t ops = 0;
+      
+      cmdCreated.clear();
+      for(uint32_t i = 0; i < cmds.createCnt; ++i) {
+        cmdCreated.emplace_back(createEntity());
+      }
+      ops += cmds.createCnt;
+      
+      for(auto& stream : cmds.addStreams) {
+        if(stream) ops += stream->apply(*this, cmdCreated);
+      }
+      
+      std::sort(cmds.removes.begin(), cmds.removes.end());
+      for(auto [id, e] : cmds.removes) {
+        removeComponent(id, e);
+      }
+      ops += cmds.removes.size();
+      
+      std::sort(cmds.destroys.begin(), cmds.destroys.end(), [](EntID a, EntID b) {
+        return entIndex(a) < entIndex(b);
+      });
+      for(EntID e : cmds.destroys) {
+        destroyEntity(e); // duplicates are stale by now and ignored
+      }
+      ops += cmds.destroys.size();
+      
+      cmds.createCnt = 0;
+      cmds.removes.clear();
+      cmds.destroys.clear();
+      cmds.dirty = false;
+      
+      return ops;
+    }
+    
+    // The frame graph runs with this thread executing pool jobs too, no blocking wait.
+    // Exclusive systems and the flushes between stages always run on this thread.
     void update(float dt) {
-      for(auto& sys : systems) {
-        sys->update(*this, dt);
+      if(stagesDirty) buildStages();
+      
+      frameDt = dt;
+      if(!stages.empty()) checkRunConditions(0);
+      frameGraph.run(pool);
+      
+      frameArena.reset();
+    }
+    
+  private:
+    QueryCache* findCache(const Signature& mask) const {
+      for(auto& cache : queryCaches) {
+        if(cache->mask == mask) return cache.get();
+      }
+      return nullptr;
+    }
+    
+    // from scratch, by signature over all live slots
+    void fillCache(QueryCache& cache) {
+      cache.clear();
+      for(size_t i = 0; i < entities.size(); ++i) {
+        if(i < signatures.size() && cache.matches(signatures[i])) cache.insert(entities[i]);
+      }
+    }
+    
+    void clearWorld() {
+      for(IComponentStor* stor : storsID) {
+        if(stor) stor->clear();
+      }
+      for(auto& g : groups) g->rebuild();
+      for(auto& cache : queryCaches) cache->clear();
+      entities.clear();
+      freeInds.clear();
+      signatures.clear();
+    }
+    
+    // After a load, before anything indexes by the loaded ids: slot i holds an id of
+    // index i, free slots are listed once and own nothing, and every storage holds
+    // exactly the live entities whose signature has it, each once.
+    bool loadedConsistent() const {
+      std::vector<uint8_t> free(entities.size(), 0);
+      for(uint32_t idx : freeInds) {
+        if(idx >= entities.size() || free[idx]) return false;
+        free[idx] = 1;
+      }
+      for(uint32_t i = 0; i < entities.size(); ++i) {
+        if(entIndex(entities[i]) != i || entities[i] == NULL_ENT) return false;
+        if(free[i] && signatures[i].any()) return false;
+      }
+      
+      std::vector<TypeID> seen(entities.size(), std::numeric_limits<TypeID>::max());
+      for(TypeID id = 0; id < storsID.size(); ++id) {
+        if(!storsID[id]) continue;
+        
+        const auto owners = storsID[id]->owners();
+        for(EntID e : owners) {
+          if(!isAlive(e)) return false;
+          const uint32_t idx = entIndex(e);
+          if(!signatures[idx].test(id) || seen[idx] == id) return false;
+          seen[idx] = id;
+        }
+        const size_t withIt = std::count_if(signatures.begin(), signatures.end(), [id](const Signature& sig) {return sig.test(id);});
+        if(withIt != owners.size()) return false;
+      }
+      return true;
+    }
+    
+    void checkRunConditions(size_t stage) {
+      for(size_t idx : stages[stage]) willRun[idx] = !systems[idx].runIf || systems[idx].runIf(*this);
+    }
+    
+    // end of a stage, nothing else is running
+    void syncStage(size_t stage) {
+      // flushed adds are newer than every system of the stage
+      changeTick.fetch_add(1, std::memory_order_relaxed);
+      flush();
+      if(stage + 1 < stages.size()) checkRunConditions(stage + 1);
+    }
+    
+    void runSystem(SystemNode& node, float dt) {
+      const ProfileCounters before = profileCounters;
+      const auto start = std::chrono::steady_clock::now();
+      
+      runTick = changeTick.fetch_add(1, std::memory_order_relaxed) + 1;
+      node.sys->update(*this, dt);
+      node.sys->lastRun = runTick;
+      runTick = 0;
+      
+      const std::chrono::duration<float, std::milli> took = std::chrono::steady_clock::now() - start;
+      node.prof.push(took.count(), profileCounters.touched - before.touched, profileCounters.ops - before.ops);
+    }
+    
+    void bindStorage(TypeID id, IComponentStor* stor) {
+      assert(id < DISABLED_BIT && "Too many component types registered!");
+      
+      if(storsID.size() <= id) {
+        storsID.resize(id + 1, nullptr);
+        groupOf.resize(id + 1, nullptr);
+        cachesOf.resize(id + 1);
+      }
+      assert(!storsID[id] && "Component registered twice!");
+      storsID[id] = stor;
+    }
+    
+    // DAG edge i -> j for every conflicting pair with i registered before j,
+    // a system's stage is the longest dependency chain leading to it
+    void buildStages() {
+      std::vector<size_t> level(systems.size(), 0);
+      size_t maxLevel = 0;
+      for(size_t j = 0; j < systems.size(); ++j) {
+        for(size_t i = 0; i < j; ++i) {
+          if(systems[i].access.conflicts(systems[j].access)) {
+            level[j] = std::max(level[j], level[i] + 1);
+          }
+        }
+        maxLevel = std::max(maxLevel, level[j]);
+      }
+      
+      stages.assign(systems.empty() ? 0 : maxLevel + 1, {});
+      for(size_t j = 0; j < systems.size(); ++j) {
+        stages[level[j]].emplace_back(j);
+      }
+      willRun.assign(systems.size(), 0);
+      
+      frameGraph.clear();
+      std::optional<JobGraph::NodeID> prevSync;
+      for(size_t k = 0; k < stages.size(); ++k) {
+        const JobGraph::NodeID first = static_cast<JobGraph::NodeID>(frameGraph.size());
+        for(size_t idx : stages[k]) {
+          const auto node = frameGraph.add([this, idx] {
+            if(willRun[idx]) runSystem(systems[idx], frameDt);
+          }, {}, systems[idx].access.exclusive);
+          if(prevSync) frameGraph.precede(*prevSync, node);
+        }
+        
+        const auto sync = frameGraph.add([this, k] {syncStage(k);}, {}, true);
+        for(auto node = first; node < sync; ++node) frameGraph.precede(node, sync);
+        prevSync = sync;
       }
+      stagesDirty = false;
+    }
+  };
+  
+  //==========================================
+  // PIPELINES
+  //==========================================
+  
+  // Ss run back to back through direct calls instead of ISystem::update, so the
+  // compiler can inline across them. Scheduled as one system: access is the union
+  // of the members' (exclusive if any is), commands flush after the last member.
+  template <typename... Ss>
+  class Pipeline : public ISystem {
+    static_assert(sizeof...(Ss) > 0, "Pipeline needs at least one system");
+    
+    std::tuple<Ss...> systems;
+    
+    template <typename S>
+    static void run(S& s, Manager& ecs, const float dt) {
+      if(auto cond = Manager::runConditionOf<S>(); cond && !cond(ecs)) return;
+      s.S::update(ecs, dt);
+      s.lastRun = ecs.currentTick();
+    }
+    
+  public:
+    Pipeline() = default;
+    explicit Pipeline(Ss&&... ss) : systems(std::move(ss)...) {}
+    
+    // members share the pipeline's tick, each still sees the ones before it;
+    // their run conditions are checked one by one
+    void update(Manager& ecs, const float dt) override {
+      std::apply([&](Ss&... s) {
+        ((run<Ss>(s, ecs, dt)), ...);
+      }, systems);
+    }
+    
+    void onLoad(Manager& ecs) override {
+      std::apply([&](Ss&... s) {
+        ((s.lastRun = 0, s.Ss::onLoad(ecs)), ...);
+      }, systems);
+    }
+    
+    template <typename S>
+    S& get() {return std::get<S>(systems);}
+    
+    static Access access() {
+      Access a;
+      a.exclusive = (Manager::accessOf<Ss>().exclusive || ...);
+      ((a.reads |= Manager::accessOf<Ss>().reads), ...);
+      ((a.writes |= Manager::accessOf<Ss>().writes), ...);
+      return a;
     }
   };
   
+  template <typename T>
+  void Prefab::Entry<T>::apply(Manager& m, std::span<const EntID> ents, uint32_t tick) const {
+    m.view<T>().addBulk(ents, value, tick);
+  }
+  
+  template <typename T>
+  size_t CommandBuffer::AddStream<T>::apply(Manager& m, const std::vector<EntID>& created) {
+    // stable: a later add of the same component wins
+    std::stable_sort(adds.begin(), adds.end(), [](const auto& a, const auto& b) {
+      return entIndex(a.first) < entIndex(b.first);
+    });
+    
+    size_t ops = 0;
+    for(auto& [e, comp] : adds) {
+      if(!m.isAlive(e)) continue;
+      m.addComponent(e, std::move(comp));
+      ++ops;
+    }
+    for(auto& [slot, comp] : pendingAdds) {
+      m.addComponent(created[slot], std::move(comp));
+      ++ops;
+    }
+    
+    adds.clear();
+    pendingAdds.clear();
+    return ops;
+  }
+  
 }; //ecs
\ No newline at end of file
@@ -2,10 +2,87 @@
 
 #include <coroutine>
 #include <exception>
+#include <array>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <new>
+
+class CoScheduler;
+
+// intrusive link of a sleeping coroutine in a wheel slot
+struct WheelNode {
+  WheelNode* prev = nullptr;
+  WheelNode* next = nullptr;
+  uint64_t due = 0; // wheel tick
+  
+  bool linked() const {return next;}
+  
+  void unlink() {
+    if(!next) return;
+    prev->next = next;
+    next->prev = prev;
+    prev = next = nullptr;
+  }
+};
+
+// Coroutine frames come from per-thread free lists bucketed by size. A frame freed on
+// another thread joins that thread's lists, the heap is only hit while they warm up.
+class FramePool {
+  static constexpr size_t GRAIN = 64; // bucket width
+  static constexpr size_t BUCKETS = 32; // frames up to 2 KiB are pooled
+  
+  struct FreeFrame {
+    FreeFrame* next;
+  };
+  
+  struct Lists {
+    std::array<FreeFrame*, BUCKETS> heads{};
+    ~Lists() {
+      for(size_t b = 0; b < BUCKETS; ++b) {
+        while(FreeFrame* f = heads[b]) {
+          heads[b] = f->next;
+          ::operator delete(f, (b + 1) * GRAIN);
+        }
+      }
+    }
+  };
+  
+  static Lists& lists() {
+    thread_local Lists l;
+    return l;
+  }
+  
+  static size_t bucket(size_t n) {return (n + GRAIN - 1) / GRAIN - 1;}
+  
+public:
+  static void* allocate(size_t n) {
+    const size_t b = bucket(n);
+    if(b >= BUCKETS) return ::operator new(n);
+    
+    auto& heads = lists().heads;
+    if(FreeFrame* f = heads[b]) {
+      heads[b] = f->next;
+      return f;
+    }
+    return ::operator new((b + 1) * GRAIN);
+  }
+  
+  static void deallocate(void* p, size_t n) {
+    const size_t b = bucket(n);
+    if(b >= BUCKETS) {
+      ::operator delete(p, n);
+      return;
+    }
+    auto& heads = lists().heads;
+    heads[b] = ::new (p) FreeFrame{heads[b]};
+  }
+};
 
 struct Task {
-  struct promise_type {
+  struct promise_type : WheelNode {
     float waitTime = 0.f;
+    CoScheduler* sched = nullptr; // set by CoScheduler::start
     
     Task get_return_object() {return {std::coroutine_handle<promise_type>::from_promise(*this)}; }
     std::suspend_always initial_suspend() {return {};}
@@ -13,20 +90,21 @@ struct Task {
     void unhandled_exception() {std::terminate();}
     void return_void() {}
     
-    std::suspend_always yield_value(float seconds) {
-      waitTime = seconds;
-      return {};
-    }
+    // with a scheduler this also books the wake-up
+    std::suspend_always yield_value(float seconds);
+    
+    // a destroyed coroutine leaves the wheel
+    ~promise_type() {unlink();}
+    
+    static void* operator new(size_t n) {return FramePool::allocate(n);}
+    static void operator delete(void* p, size_t n) {FramePool::deallocate(p, n);}
   };
   
   std::coroutine_handle<promise_type> handle = nullptr;
   
   Task(std::coroutine_handle<promise_type> h) : handle(h) {}
   ~Task() {
-    if(handle) {
-      handle.destroy();
-      Logger::info("Coroutine died.");
-    }
+    if(handle) handle.destroy();
   }
   
   Task(const Task&) = delete;
@@ -51,4 +129,118 @@ struct Task {
     handle.resume();
     return !handle.done();
   }
-};
\ No newline at end of file
+};
+
+// Resumes Tasks when their co_yield delay has passed. Sleepers sit in a hierarchical
+// timing wheel (4 levels of 64 slots, TICK seconds per step), each step only touches
+// the coroutines that are due and the slot cascading into them. Delays are rounded up
+// to whole steps counted from the time advanced so far, a task resumes up to one TICK
+// late but never early. Not thread-safe.
+class CoScheduler {
+public:
+  static constexpr float TICK = 1.f / 64.f;
+
+private:
+  static constexpr uint32_t BITS = 6;
+  static constexpr uint32_t SLOTS = 1u << BITS;
+  static constexpr uint32_t LEVELS = 4;
+  static constexpr uint64_t MAX_DELAY = (uint64_t(1) << (BITS * LEVELS)) - 1; // ~73h
+  
+  std::array<WheelNode, SLOTS * LEVELS> heads; // circular list sentinels
+  uint64_t now = 0;
+  float acc = 0.f;
+  
+  WheelNode& head(uint32_t level, uint64_t tick) {
+    return heads[level * SLOTS + ((tick >> (BITS * level)) & (SLOTS - 1))];
+  }
+  
+  // lowest level whose span covers the delay
+  void link(WheelNode& n) {
+    const uint64_t delta = n.due - now;
+    uint32_t level = 0;
+    while(level + 1 < LEVELS && delta >= (uint64_t(1) << (BITS * (level + 1)))) ++level;
+    
+    WheelNode& h = head(level, n.due);
+    n.prev = &h;
+    n.next = h.next;
+    h.next->prev = &n;
+    h.next = &n;
+  }
+  
+  // sleepers of the slot the wheel just reached move to finer levels
+  void cascade(uint32_t level) {
+    WheelNode& h = head(level, now);
+    while(h.next != &h) {
+      WheelNode* n = h.next;
+      n->unlink();
+      link(*n);
+    }
+  }
+  
+  void step() {
+    ++now;
+    for(uint32_t level = LEVELS - 1; level > 0; --level) {
+      if((now & ((uint64_t(1) << (BITS * level)) - 1)) == 0) cascade(level);
+    }
+    
+    // one at a time, a resumed coroutine may destroy others in this slot
+    WheelNode& h = head(0, now);
+    while(h.next != &h) {
+      WheelNode* n = h.next;
+      n->unlink();
+      std::coroutine_handle<Task::promise_type>::from_promise(static_cast<Task::promise_type&>(*n)).resume();
+    }
+  }
+
+public:
+  CoScheduler() {
+    for(auto& h : heads) h.prev = h.next = &h;
+  }
+  
+  // sleeping tasks are dropped, they won't be resumed again
+  ~CoScheduler() {
+    for(auto& h : heads) {
+      while(h.next != &h) {
+        WheelNode* n = h.next;
+        n->unlink();
+        static_cast<Task::promise_type*>(n)->sched = nullptr;
+      }
+    }
+  }
+  
+  CoScheduler(const CoScheduler&) = delete;
+  CoScheduler& operator=(const CoScheduler&) = delete;
+  
+  // first resume on the next step
+  void start(Task& task) {
+    if(!task.handle || task.handle.done()) return;
+    auto& p = task.handle.promise();
+    p.sched = this;
+    p.unlink();
+    p.due = now + 1;
+    link(p);
+  }
+  
+  // a Task resumed by hand may yield while still booked, it moves to the new slot
+  void sleep(Task::promise_type& p, float seconds) {
+    p.unlink();
+    // acc is time already past the current step
+    const float ticks = std::clamp(std::ceil((seconds + acc) / TICK), 1.f, static_cast<float>(MAX_DELAY));
+    p.due = now + static_cast<uint64_t>(ticks);
+    link(p);
+  }
+  
+  void advance(float dt) {
+    acc += dt;
+    while(acc >= TICK) {
+      acc -= TICK;
+      step();
+    }
+  }
+};
+
+inline std::suspend_always Task::promise_type::yield_value(float seconds) {
+  waitTime = seconds;
+  if(sched) sched->sleep(*this, seconds);
+  return {};
+}
@@ -1,71 +1,422 @@
 #pragma once
 
 #include <vector>
-#include <queue>
 #include <thread>
-#include <mutex>
-#include <condition_variable>
-#include <future>
-#include <atomic>
+#include <functional>
 #include <optional>
+#include <variant>
+#include <utility>
+#include <atomic>
+#include <memory>
+#include <array>
+#include <new>
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+#include <algorithm>
+#include <initializer_list>
+#include <exception>
+#include <mutex>
+#include <cstdlib>
 
 #include <fmt/core.h>
 #include <fmt/color.h>
 
+class ThreadPool;
+
+// Move-only void() callable. Up to INLINE bytes it lives in place, a bigger one
+// goes to the heap, so keep captures to a few pointers and indices.
+class SmallTask {
+public:
+  static constexpr size_t INLINE = 64;
+
+  template<class F>
+  static constexpr bool FITS = sizeof(F) <= INLINE && alignof(F) <= alignof(std::max_align_t)
+    && std::is_nothrow_move_constructible_v<F>;
+
+private:
+  struct Ops {
+    void (*call)(void*);
+    void (*move)(void* dst, void* src); // leaves src destroyed
+    void (*destroy)(void*);
+  };
+
+  template<class F>
+  static constexpr Ops inlineOps {
+    [](void* p) {(*static_cast<F*>(p))();},
+    [](void* dst, void* src) {
+      ::new (dst) F(std::move(*static_cast<F*>(src)));
+      static_cast<F*>(src)->~F();
+    },
+    [](void* p) {static_cast<F*>(p)->~F();}
+  };
+
+  template<class F>
+  static constexpr Ops heapOps {
+    [](void* p) {(**static_cast<F**>(p))();},
+    [](void* dst, void* src) {*static_cast<F**>(dst) = *static_cast<F**>(src);},
+    [](void* p) {delete *static_cast<F**>(p);}
+  };
+
+  alignas(std::max_align_t) std::byte buf[INLINE];
+  const Ops* ops = nullptr;
+
+public:
+  SmallTask() = default;
+
+  template<class F> requires (!std::is_same_v<std::decay_t<F>, SmallTask>)
+  SmallTask(F && fn) {
+    using Fn = std::decay_t<F>;
+    if constexpr (FITS<Fn>) {
+      ::new (static_cast<void*>(buf)) Fn(std::forward<F>(fn));
+      ops = &inlineOps<Fn>;
+    }
+    else {
+      ::new (static_cast<void*>(buf)) Fn*(new Fn(std::forward<F>(fn)));
+      ops = &heapOps<Fn>;
+    }
+  }
+
+  SmallTask(SmallTask && other) noexcept : ops(other.ops) {
+    if(ops) ops->move(buf, other.buf);
+    other.ops = nullptr;
+  }
+
+  SmallTask& operator=(SmallTask && other) noexcept {
+    if(this != &other) {
+      reset();
+      ops = other.ops;
+      if(ops) ops->move(buf, other.buf);
+      other.ops = nullptr;
+    }
+    return *this;
+  }
+
+  SmallTask(const SmallTask&) = delete;
+  SmallTask& operator=(const SmallTask&) = delete;
+
+  ~SmallTask() { reset(); }
+
+  void reset() {
+    if(ops) ops->destroy(buf);
+    ops = nullptr;
+  }
+
+  void operator()() { ops->call(buf); }
+  explicit operator bool() const { return ops; }
+};
+
+// One unit of pool work. A job counts itself and its unfinished children,
+// waiting on it waits for the whole subtree.
+struct alignas(64) Job {
+  SmallTask task;
+  Job* parent = nullptr;
+  std::atomic<int32_t> unfinished{0};
+};
+
+// Result of ThreadPool::add_task. The shared state comes from a per-thread free list
+// and goes back to the list of whichever thread drops it last, no allocation once warm.
+template<class T>
+class TaskHandle {
+  using Value = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+  struct State {
+    std::atomic<bool> done{false};
+    std::atomic<int32_t> refs{0};
+    std::optional<Value> value;
+    std::exception_ptr error; // thrown by the task, rethrown by get()
+    State* nextFree = nullptr;
+  };
+
+  struct FreeList {
+    State* head = nullptr;
+    ~FreeList() {
+      while(head) delete std::exchange(head, head->nextFree);
+    }
+  };
+  static inline thread_local FreeList freeList;
+
+  static State* acquire() {
+    State* st = freeList.head;
+    if(st) freeList.head = st->nextFree;
+    else st = new State;
+    st->refs.store(2, std::memory_order_relaxed); // the handle and the job
+    return st;
+  }
+
+  static void release(State* st) {
+    if(st->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+    st->value.reset();
+    st->error = nullptr;
+    st->done.store(false, std::memory_order_relaxed);
+    st->nextFree = freeList.head;
+    freeList.head = st;
+  }
+
+  State* state = nullptr;
+  ThreadPool* pool = nullptr;
+  const Job* job = nullptr; // waiting helps only with this one
+
+  friend class ThreadPool;
+
+public:
+  TaskHandle() = default;
+  TaskHandle(TaskHandle && other) noexcept
+    : state(std::exchange(other.state, nullptr)), pool(other.pool), job(other.job) {}
+  TaskHandle& operator=(TaskHandle && other) noexcept {
+    if(this != &other) {
+      if(state) release(state);
+      state = std::exchange(other.state, nullptr);
+      pool = other.pool;
+      job = other.job;
+    }
+    return *this;
+  }
+  TaskHandle(const TaskHandle&) = delete;
+  TaskHandle& operator=(const TaskHandle&) = delete;
+
+  ~TaskHandle() {
+    if(state) release(state);
+  }
+
+  bool valid() const { return state; }
+  bool ready() const { return state && state->done.load(std::memory_order_acquire); }
+
+  // runs the task on the calling thread if nobody took it yet, else waits for it;
+  // a thread outside the pool only waits
+  void wait() const;
+
+  // once, the handle is empty afterwards; rethrows what the task threw
+  T get();
+};
+
+// Chase-Lev work-stealing deque: the owner pushes/pops at the bottom, thieves take
+// from the top. Fixed capacity, push fails when full.
+class JobDeque {
+  static constexpr int64_t CAP = 4096;
+  static constexpr int64_t MASK = CAP - 1;
+
+  alignas(64) std::atomic<int64_t> top{0};
+  alignas(64) std::atomic<int64_t> bottom{0};
+  std::array<std::atomic<Job*>, CAP> buf{};
+
+public:
+  // owner only
+  bool push(Job* job) {
+    const int64_t b = bottom.load(std::memory_order_relaxed);
+    const int64_t t = top.load(std::memory_order_acquire);
+    if(b - t >= CAP) return false;
+
+    buf[b & MASK].store(job, std::memory_order_relaxed);
+    bottom.store(b + 1, std::memory_order_release);
+    return true;
+  }
+
+  // owner only, newest first
+  Job* pop() {
+    const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+
+    if(t > b) {
+      bottom.store(b + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+
+    Job* job = buf[b & MASK].load(std::memory_order_relaxed);
+    if(t == b) {
+      // last one, race the thieves for it
+      if(!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) job = nullptr;
+      bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return job;
+  }
+
+  // any thread, oldest first
+  Job* steal() {
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64_t b = bottom.load(std::memory_order_acquire);
+    if(t >= b) return nullptr;
+
+    Job* job = buf[t & MASK].load(std::memory_order_relaxed);
+    if(!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) return nullptr;
+    return job;
+  }
+};
+
+// Work-stealing pool. Every worker and the thread that created the pool own a
+// deque and a ring of jobs, so creating and running a job never locks, and only
+// allocates while more than RING jobs of one thread are in flight.
+// Idle workers steal from the others, wait() runs the awaited subtree's jobs until it's done.
+// Other threads can only add_task(), through a shared deque behind a mutex.
 class ThreadPool {
+  static constexpr size_t RING = 4096; // jobs per ring, a thread gets another one when all are in flight
+  static constexpr int SPINS = 64; // empty rounds before a worker sleeps
+  static constexpr size_t MAX_CHUNKS = RING / 8; // parallel_for grows the grain past this
+
+  struct alignas(64) Slot {
+    JobDeque deque;
+    std::vector<std::unique_ptr<Job[]>> rings;
+    size_t next = 0;
+    
+    Slot() {rings.emplace_back(std::make_unique<Job[]>(RING));}
+  };
+
+  std::vector<std::unique_ptr<Slot>> slots; // workers first, then the owner thread, then the shared one
+  std::mutex injectMtx; // guards pushes to the shared slot, workers only steal from it
   std::vector<std::jthread> workers;
-  std::queue<std::function<void()>> tasks;
-  std::mutex qMtx;
-  std::condition_variable qCnd;
+  std::thread::id owner;
+  std::atomic<uint32_t> wakeEpoch{0};
+  std::atomic<int32_t> sleepers{0};
   std::atomic<bool> stop;
 
+  static inline thread_local const ThreadPool* tlsPool = nullptr;
+  static inline thread_local size_t tlsSlot = 0;
+
+  template<class> friend class TaskHandle;
+
+  bool member() const {
+    return tlsPool == this || std::this_thread::get_id() == owner;
+  }
+
+  // the calling thread's own slot, its deque is single producer so a foreign thread stops here
+  size_t slotIdx() const {
+    if(tlsPool == this) return tlsSlot;
+    if(std::this_thread::get_id() != owner) {
+      fmt::print(stderr, fmt::fg(fmt::color::red), "##ERROR##\tJobs come from pool workers or the thread that created the pool, other threads use add_task()\n");
+      std::abort();
+    }
+    return slots.size() - 2;
+  }
+
+  template<class F>
+  Job* makeJob(Slot& slot, F && fn, Job* parent);
+
+  Job* findJob(size_t self) {
+    if(Job* job = slots[self]->deque.pop()) return job;
+
+    for(size_t k = 1; k < slots.size(); ++k) {
+      if(Job* job = slots[(self + k) % slots.size()]->deque.steal()) return job;
+    }
+    return nullptr;
+  }
+
+  // Next job slot not in flight. One is only still busy with more than RING jobs
+  // alive on this thread, then it's skipped; a full lap without a free one adds a ring.
+  static Job* nextFree(Slot& slot) {
+    const size_t cap = slot.rings.size() * RING;
+    for(size_t tries = 0; tries < cap; ++tries) {
+      const size_t i = slot.next++ % cap;
+      Job* job = &slot.rings[i / RING][i % RING];
+      if(job->unfinished.load(std::memory_order_acquire) == 0) return job;
+    }
+    slot.rings.emplace_back(std::make_unique<Job[]>(RING));
+    slot.next = cap + 1;
+    return &slot.rings.back()[0];
+  }
+
+  static bool within(const Job* job, const Job* scope) {
+    for(; job; job = job->parent) {
+      if(job == scope) return true;
+    }
+    return false;
+  }
+
+  // Own deque only, newest job of scope's subtree. Anything else a waiter ran could be
+  // a whole system or graph node, nested inside the job that waits. Jobs above the
+  // one found go back in their order.
+  Job* findScoped(size_t self, const Job* scope) {
+    JobDeque& deque = slots[self]->deque;
+    std::array<Job*, 32> skipped;
+    size_t cnt = 0;
+    Job* job = nullptr;
+    while(cnt < skipped.size() && (job = deque.pop())) {
+      if(within(job, scope)) break;
+      skipped[cnt++] = job;
+      job = nullptr;
+    }
+    while(cnt > 0) deque.push(skipped[--cnt]);
+    return job;
+  }
+
+  void execute(Job* job) {
+    job->task();
+    job->task.reset();
+    finish(job);
+  }
+
+  // parent is read first, a job at zero may already be reused by its owner
+  void finish(Job* job) {
+    while(job) {
+      Job* parent = job->parent;
+      if(job->unfinished.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+      job = parent;
+    }
+  }
+
+  void wake(bool all) {
+    wakeEpoch.fetch_add(1, std::memory_order_seq_cst);
+    if(sleepers.load(std::memory_order_seq_cst) == 0) return;
+    if(all) wakeEpoch.notify_all();
+    else wakeEpoch.notify_one();
+  }
+
+  void workerLoop(size_t self) {
+    tlsPool = this;
+    tlsSlot = self;
+
+    int idle = 0;
+    while(1) {
+      if(Job* job = findJob(self)) {
+        execute(job);
+        idle = 0;
+        continue;
+      }
+      if(stop) return;
+      if(++idle < SPINS) {
+        std::this_thread::yield();
+        continue;
+      }
+
+      // a push after this load changes the epoch, so the wait can't miss it
+      sleepers.fetch_add(1, std::memory_order_seq_cst);
+      const uint32_t epoch = wakeEpoch.load(std::memory_order_seq_cst);
+      if(Job* job = findJob(self)) {
+        sleepers.fetch_sub(1, std::memory_order_relaxed);
+        execute(job);
+        idle = 0;
+        continue;
+      }
+      if(!stop) wakeEpoch.wait(epoch, std::memory_order_seq_cst);
+      sleepers.fetch_sub(1, std::memory_order_relaxed);
+      idle = 0;
+    }
+  }
+
 public:
-  ThreadPool(size_t num) : stop(0) {
+  ThreadPool(size_t num) : owner(std::this_thread::get_id()), stop(0) {
     if(num == 0) {
       fmt::print(fmt::fg(fmt::color::yellow), "##WARNING##\tNum of threads can't be 0. Num sets to 2\n");
       num = 2;
     }
     fmt::print(fmt::fg(fmt::color::orange), "##INFO##\tNum of threads: {}\n", num);
-    workers.reserve(num);
 
+    slots.reserve(num + 2);
+    for(size_t i = 0; i < num + 2; ++i) slots.emplace_back(std::make_unique<Slot>());
+
+    workers.reserve(num);
     for(size_t i = 0; i < num; ++i) {
-      workers.emplace_back([this] {
-        while(1) {
-          std::optional<std::function<void()>> task;
-          
-          // -
-          {
-            std::unique_lock<std::mutex> lock(this->qMtx);
-            qCnd.wait(lock, [this] {
-              return stop || !tasks.empty();
-            });
-            if(stop && tasks.empty()) {
-              return;
-            }
-            if(!tasks.empty()) {
-              task = std::move(tasks.front());
-              tasks.pop();
-            } else {
-              continue;
-            }
-          }
-          // -
-          
-          if(task) (*task)();
-        }
-      });
+      workers.emplace_back([this, i] {workerLoop(i);});
     }
   }
-  
+
   ~ThreadPool() {
-    // -
-    {
-      std::unique_lock<std::mutex> lock(qMtx);
-      stop = 1;
-    }
-    // -
+    stop = 1;
+    wakeEpoch.fetch_add(1, std::memory_order_seq_cst);
+    wakeEpoch.notify_all();
 
-    qCnd.notify_all();
     for(auto & worker : workers) {
       if(worker.joinable()) {
         worker.join();
@@ -73,36 +424,292 @@ public:
     }
   }
 
+  // fn() runs once the job is passed to run(). With a parent, waiting on the parent
+  // also waits for this job. fn is stored in the job, bigger than SmallTask::INLINE
+  // it goes to the heap. Jobs are created, run and waited on by pool workers and the
+  // thread that created the pool only.
+  template<class F>
+  Job* createJob(F && fn, Job* parent = nullptr) {
+    return makeJob(*slots[slotIdx()], std::forward<F>(fn), parent);
+  }
+
+  // a job without work, groups children under one handle
+  Job* createJob(Job* parent = nullptr) {
+    return createJob([] {}, parent);
+  }
+
+  // queued on the calling thread's deque, runs right here when that is full
+  void run(Job* job) {
+    if(!slots[slotIdx()]->deque.push(job)) {
+      execute(job);
+      return;
+    }
+    wake(false);
+  }
+
+  // One queued job on the calling thread, own or stolen, false when there was none.
+  // For loops outside any job, inside one it could start unrelated work nested.
+  bool runOne() {
+    Job* job = findJob(slotIdx());
+    if(job) execute(job);
+    return job;
+  }
+
+  // one job of scope's subtree from the calling thread's deque
+  bool runOne(const Job* scope) {
+    Job* job = findScoped(slotIdx(), scope);
+    if(job) execute(job);
+    return job;
+  }
+
+  // Runs jobs of the subtree on the calling thread until job and all its children are
+  // done. Children taken by other threads are left to them.
+  void wait(const Job* job) {
+    while(job->unfinished.load(std::memory_order_acquire) > 0) {
+      if(!runOne(job)) std::this_thread::yield();
+    }
+  }
+
+  // f(args...) on the pool, the handle waits for and returns the result. Any thread
+  // may call it, one outside the pool goes through the shared slot and its wait()
+  // doesn't run jobs.
   template<class F, class... Args>
-  auto add_task(F && f, Args && ... args) -> std::future<typename std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>>;
+  auto add_task(F && f, Args && ... args) -> TaskHandle<std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>>;
+
+  // Runs fn(begin, end) over [0, count) split into chunks of `grain` items (more when
+  // that would be over MAX_CHUNKS chunks). The caller runs chunks too while it waits,
+  // so it's safe to call from inside a pool job. Serial when count <= grain.
+  template<class F>
+  void parallel_for(size_t count, size_t grain, F && fn);
 
   size_t getCount() const { return workers.size(); }
 };
 
 
+template<class F>
+Job* ThreadPool::makeJob(Slot& slot, F && fn, Job* parent) {
+  Job* job = nextFree(slot);
+
+  job->task = SmallTask(std::forward<F>(fn));
+  job->parent = parent;
+  job->unfinished.store(1, std::memory_order_relaxed);
+  if(parent) parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+
+  return job;
+}
+
+
 template<class F, class... Args>
-auto ThreadPool::add_task(F && f, Args && ... args) -> std::future<typename std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>> {
-  using retType = typename std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>;
+auto ThreadPool::add_task(F && f, Args && ... args) -> TaskHandle<std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>> {
+  using retType = std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>;
+  using Handle = TaskHandle<retType>;
 
-  auto task = std::make_shared<std::packaged_task<retType()>>(
-    std::bind(std::forward<F>(f), std::forward<Args>(args)...)
-  );
+  if(stop) {
+    fmt::print(fmt::fg(fmt::color::yellow), "##WARNING##\tUnable to add task when pool is stopped\n");
+    return Handle();
+  }
 
-  std::future<retType> res = task->get_future();
+  Handle res;
+  res.state = Handle::acquire();
+  res.pool = this;
 
-  // -
+  auto body = [st = res.state, fn = std::forward<F>(f), ...args = std::forward<Args>(args)]() mutable {
+    try {
+      if constexpr (std::is_void_v<retType>) {
+        std::invoke(std::move(fn), std::move(args)...);
+        st->value.emplace();
+      }
+      else {
+        st->value.emplace(std::invoke(std::move(fn), std::move(args)...));
+      }
+    }
+    catch(...) {
+      st->error = std::current_exception();
+    }
+    st->done.store(true, std::memory_order_release);
+    Handle::release(st);
+  };
+
+  if(member()) {
+    Job* job = createJob(std::move(body));
+    res.job = job;
+    run(job);
+    return res;
+  }
+
+  Slot& shared = *slots.back();
+  Job* job;
+  bool queued;
   {
-    std::unique_lock<std::mutex> lock(qMtx);
-    if(stop) {
-      fmt::print(fmt::fg(fmt::color::yellow), "##WARNING##\tUnable to add task when pool is stopped\n");
-      return std::future<retType>();
-    }
-    tasks.emplace([task] {
-      (*task)();
-    });
-    
-    qCnd.notify_one();
+    std::lock_guard lock(injectMtx);
+    job = makeJob(shared, std::move(body), nullptr);
+    queued = shared.deque.push(job);
+  }
+  res.job = job;
+  if(queued) wake(false);
+  else execute(job);
+  return res;
+}
+
+
+template<class T>
+void TaskHandle<T>::wait() const {
+  assert(state && "Waiting on an empty TaskHandle!");
+  const bool member = pool->member();
+  while(!state->done.load(std::memory_order_acquire)) {
+    if(!member || !pool->runOne(job)) std::this_thread::yield();
+  }
+}
+
+
+template<class T>
+T TaskHandle<T>::get() {
+  wait();
+  State* st = std::exchange(state, nullptr);
+  if(st->error) {
+    std::exception_ptr error = std::move(st->error);
+    release(st);
+    std::rethrow_exception(error);
+  }
+  if constexpr (std::is_void_v<T>) {
+    release(st);
+  }
+  else {
+    T res = std::move(*st->value);
+    release(st);
     return res;
   }
-  // -
-}
\ No newline at end of file
+}
+
+
+template<class F>
+void ThreadPool::parallel_for(size_t count, size_t grain, F && fn) {
+  grain = std::max({grain, size_t(1), (count + MAX_CHUNKS - 1) / MAX_CHUNKS});
+  if(count <= grain) {
+    if(count > 0) fn(size_t(0), count);
+    return;
+  }
+
+  const size_t chunks = (count + grain - 1) / grain;
+  auto* body = &fn;
+
+  // newest chunk is popped back here first, the rest gets stolen
+  Job* root = createJob();
+  for(size_t c = 1; c < chunks; ++c) {
+    const size_t b = c * grain;
+    const size_t e = std::min(b + grain, count);
+    Job* job = createJob([body, b, e] {(*body)(b, e);}, root);
+    if(!slots[slotIdx()]->deque.push(job)) execute(job);
+  }
+  wake(true);
+
+  fn(size_t(0), std::min(grain, count));
+  finish(root);
+  wait(root);
+}
+
+
+// Work described once and run as often as needed. A node starts when every node it
+// comes after is done, finishing releases its continuations. run() is the barrier:
+// it returns once all nodes are done and runs nodes itself until then.
+class JobGraph {
+public:
+  using NodeID = uint32_t;
+
+private:
+  struct Node {
+    SmallTask fn;
+    std::vector<NodeID> next; // continuations
+    uint32_t deps = 0;
+    bool onCaller = false; // never handed to the pool
+  };
+
+  std::vector<Node> nodes;
+  std::vector<NodeID> callerNodes;
+  std::unique_ptr<std::atomic<uint32_t>[]> pending; // deps left this run
+  std::unique_ptr<std::atomic<bool>[]> ready; // released caller nodes
+  size_t slotCnt = 0;
+  std::atomic<uint32_t> remaining{0};
+  ThreadPool* pool = nullptr;
+  Job* root = nullptr; // parent of this run's node jobs
+
+  void release(NodeID n) {
+    if(nodes[n].onCaller) ready[n].store(true, std::memory_order_release);
+    else pool->run(pool->createJob([this, n] {execute(n);}, root));
+  }
+
+  void execute(NodeID n) {
+    nodes[n].fn();
+    for(NodeID c : nodes[n].next) {
+      if(pending[c].fetch_sub(1, std::memory_order_acq_rel) == 1) release(c);
+    }
+    remaining.fetch_sub(1, std::memory_order_release);
+  }
+
+public:
+  // after: nodes that must finish first, added before this one
+  template<class F>
+  NodeID add(F && fn, std::initializer_list<NodeID> after = {}, bool onCaller = false) {
+    const NodeID id = static_cast<NodeID>(nodes.size());
+    nodes.push_back(Node{SmallTask(std::forward<F>(fn)), {}, 0, onCaller});
+    if(onCaller) callerNodes.push_back(id);
+    for(NodeID a : after) precede(a, id);
+    return id;
+  }
+
+  void precede(NodeID before, NodeID after) {
+    assert(before < after && "Dependencies go from earlier to later nodes!");
+    nodes[before].next.push_back(after);
+    ++nodes[after].deps;
+  }
+
+  void clear() {
+    nodes.clear();
+    callerNodes.clear();
+  }
+
+  size_t size() const { return nodes.size(); }
+
+  // Without a pool the nodes run here in insertion order, which respects every
+  // dependency. Not reentrant, one run() of a graph at a time. The calling thread
+  // only helps with this graph's nodes, never with jobs that aren't part of it.
+  void run(ThreadPool* tp) {
+    if(!tp) {
+      for(auto& node : nodes) node.fn();
+      return;
+    }
+    if(nodes.empty()) return;
+
+    if(slotCnt < nodes.size()) {
+      slotCnt = nodes.size();
+      pending = std::make_unique<std::atomic<uint32_t>[]>(slotCnt);
+      ready = std::make_unique<std::atomic<bool>[]>(slotCnt);
+    }
+    pool = tp;
+    for(size_t i = 0; i < nodes.size(); ++i) {
+      pending[i].store(nodes[i].deps, std::memory_order_relaxed);
+      ready[i].store(false, std::memory_order_relaxed);
+    }
+    remaining.store(static_cast<uint32_t>(nodes.size()), std::memory_order_relaxed);
+    root = pool->createJob();
+
+    for(NodeID n = 0; n < nodes.size(); ++n) {
+      if(nodes[n].deps == 0) release(n);
+    }
+
+    while(remaining.load(std::memory_order_acquire) > 0) {
+      bool ran = false;
+      for(NodeID n : callerNodes) {
+        if(ready[n].exchange(false, std::memory_order_acq_rel)) {
+          execute(n);
+          ran = true;
+        }
+      }
+      if(!ran && !pool->runOne(root)) std::this_thread::yield();
+    }
+
+    // node jobs may still be on their way out
+    pool->run(root);
+    pool->wait(root);
+  }
+};
@@ -40,6 +40,9 @@ namespace mip {
       // || !m_scene->createMobs(m_window->m_width / 3, m_window->m_height / 3, m_renderer.get(), "../../assets/textures/mob1.png")
       
     ) return false;   
+#ifndef NDEBUG
+    if(!m_scene->checkSnapshotRoundTrip()) return false;
+#endif
     // scene==================================================
     
     Logger::info("Application initialized successfully");
@@ -80,6 +83,7 @@ namespace mip {
       
     }
     
+    m_scene->dumpProfile("system_profile");
   }
   
   void Application::processInput(GLFWwindow * wnd, const float dT) {
@@ -90,6 +94,13 @@ namespace mip {
       glfwSetWindowShouldClose(wnd, true);
 		}
     
+    // between frames, so no commands are pending
+    const bool save = glfwGetKey(wnd, GLFW_KEY_F5) == GLFW_PRESS;
+    const bool load = glfwGetKey(wnd, GLFW_KEY_F9) == GLFW_PRESS;
+    if(save && !m_saveHeld) m_scene->saveSnapshot("quicksave.snap");
+    if(load && !m_loadHeld) m_scene->loadSnapshot("quicksave.snap");
+    m_saveHeld = save;
+    m_loadHeld = load;
 	}
   
 }; //mip
\ No newline at end of file
@@ -21,6 +21,10 @@ namespace mip {
     
     std::unique_ptr<game::Scene> m_scene = nullptr;
     
+    // quick save/load react to the press, not while the key is held
+    bool m_saveHeld = false;
+    bool m_loadHeld = false;
+    
     void processInput(GLFWwindow* wnd, const float dT);
     
   };
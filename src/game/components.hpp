@@ -23,6 +23,27 @@ namespace game {
     float speed; //4
   }; //33
   
+}; //game
+
+// movement, steering and collisions only walk pos/vel, keep every field in its own array
+template <>
+struct ecs::SoALayout<game::Kinematics> {
+  static constexpr auto fields = std::make_tuple(
+    &game::Kinematics::z, &game::Kinematics::pos, &game::Kinematics::scale,
+    &game::Kinematics::vel, &game::Kinematics::rot, &game::Kinematics::speed
+  );
+  struct Ref {
+    uint8_t& z;
+    glm::vec2& pos;
+    glm::vec2& scale;
+    glm::vec2& vel;
+    float& rot;
+    float& speed;
+  };
+};
+
+namespace game {
+  
   struct Sprite {
     // ecs::Handle<std::shared_ptr<mip::ITexture>> texHandle;
     std::shared_ptr<mip::IMesh> mesh; //16
@@ -71,11 +92,10 @@ namespace game {
     float radius;
   }; //4
   
+  // started on the CoScheduler resource by PatrolSystem once added
   struct Script {
     Task task;
-    float timer = 0.f;
-    bool active = true;
-  }; //16
+  }; //8
   
   struct BgTile {
     glm::vec2 offset;
@@ -84,7 +104,6 @@ namespace game {
   struct PlayerTag {};
   struct EnemyTag {};
   struct WeaponTag {};
-  struct Active { bool value = true; };
   enum SkillTag : uint32_t {
     None = 0,
     Fire       = 1 << 0,
@@ -97,7 +116,6 @@ namespace game {
     AoE        = 1 << 7,
     Projectile = 1 << 8,
   };
-  struct DirtyStatsTag {};
   struct InventoryItem {
     ecs::EntID owner = ecs::NULL_ENT;
     bool isEquipped = false;
@@ -193,10 +211,19 @@ namespace game {
     uint32_t curLvl = 0;
     uint32_t maxLvl = 10;
   }; //16
+  // resources, see Manager::resource()
   struct GameState {
     bool isPaused = false;
     bool isLvlUp = false;
   }; //8
+  struct PlayerRef {
+    ecs::EntID ent = ecs::NULL_ENT;
+  };
+  
+  // run condition for gameplay systems
+  inline bool notPaused(ecs::Manager& manager) {
+    return !manager.resource<GameState>().isPaused;
+  }
   
   struct Health {
     float cur;
@@ -204,10 +231,12 @@ namespace game {
     float iFrames = 0.f;
   }; //12
   
+  // target may be attached itself, chains resolve parents first
   struct AttachTo {
     ecs::EntID target;
     glm::vec2 offset{0.f, 0.f};
-  }; //12
+    uint16_t depth = 0; // set by AttachmentSystem
+  }; //16
   
   struct DamageDealer {
     float amount;
@@ -253,4 +282,20 @@ namespace game {
   struct Pierce {
     int count = 1;
   };
-}; //game
\ No newline at end of file
+  
+  // every component of the game, position in the list is its compile-time id
+  using Components = ecs::TypeList<
+    BgTile, Script,
+    PlayerTag, SkillTag, InventoryItem, PlayerStats, PermanentStats,
+    ActiveSkillGem, SupGem, LinkedGems, Kinematics, Sprite, ColorTint, FlashEffect, Animator,
+    Exp, UITag, UIProgressBar, BarType, UIAnchor, AnchorH, AnchorV,
+    EnemyTag, WeaponTag, CircleCollider, Health, DamageDealer, Resistances,
+    PulseCooldown, Lifetime, AttachTo, Pierce, StatusEffects, AppliesDoT
+  >;
+}; //game
+
+template <typename T>
+  requires ecs::InList<T, game::Components>
+struct ecs::ComponentInfo<T> {
+  static constexpr ecs::TypeID id = ecs::indexOf<T>(game::Components{});
+};
\ No newline at end of file
@@ -7,7 +7,7 @@ namespace game {
   
   inline Task squarePatrol(ecs::Manager& manager, ecs::EntID e, float moveTime, float waitTime, float speed) {
     while(true) {
-      auto* k = manager.getComponent<Kinematics>(e);
+      auto k = manager.getComponent<Kinematics>(e);
       if(!k) co_return;
       k->vel = {speed, 0.f};
       co_yield moveTime;
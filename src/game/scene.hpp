@@ -6,6 +6,8 @@
 #include "../game/systems.hpp"
 #include "../game/mob_logic.hpp"
 
+#include <fstream>
+
 class GLFWwindow;
 
 
@@ -13,52 +15,70 @@ namespace game {
   
   class Scene {
     
+    // component arrays come out of big pooled chunks instead of one heap block each
+    std::pmr::synchronized_pool_resource m_compMem{std::pmr::pool_options{
+      .max_blocks_per_chunk = 64,
+      .largest_required_pool_block = 1 << 21
+    }};
+    std::unique_ptr<ThreadPool> m_pool = nullptr;
     std::unique_ptr<ecs::Manager> m_manager = nullptr;
     std::unique_ptr<SkillDB> m_skillDB = nullptr;
     float scrW, scrH;
     
-    bool regComponents() {
-      m_manager->registerComponent<BgTile>();
-      m_manager->registerComponent<Script>();
-      
-      m_manager->registerComponent<PlayerTag>();
-      m_manager->registerComponent<DirtyStatsTag>();
-      m_manager->registerComponent<SkillTag>();
-      m_manager->registerComponent<InventoryItem>();
-      m_manager->registerComponent<PlayerStats>();
-      m_manager->registerComponent<PermanentStats>();
-      m_manager->registerComponent<ActiveSkillGem>();
-      m_manager->registerComponent<SupGem>();
-      m_manager->registerComponent<LinkedGems>();
-      m_manager->registerComponent<Kinematics>();
-      m_manager->registerComponent<Sprite>();
-      m_manager->registerComponent<ColorTint>();
-      m_manager->registerComponent<FlashEffect>();
-      m_manager->registerComponent<Animator>();
-      
-      m_manager->registerComponent<Exp>();
-      m_manager->registerComponent<GameState>();
-      m_manager->registerComponent<UITag>();
-      m_manager->registerComponent<UIProgressBar>();
-      m_manager->registerComponent<BarType>();
-      m_manager->registerComponent<UIAnchor>();
-      m_manager->registerComponent<AnchorH>();
-      m_manager->registerComponent<AnchorV>();
-      
-      m_manager->registerComponent<EnemyTag>();
-      m_manager->registerComponent<WeaponTag>();
-      m_manager->registerComponent<Active>();
-      m_manager->registerComponent<CircleCollider>();
-      m_manager->registerComponent<Health>();
-      m_manager->registerComponent<DamageDealer>();
-      m_manager->registerComponent<Resistances>();
-      m_manager->registerComponent<PulseCooldown>();
-      m_manager->registerComponent<Lifetime>();
-      m_manager->registerComponent<AttachTo>();
-      m_manager->registerComponent<Pierce>();
+    // GPU objects can't leave the process, snapshots refer to them by index here
+    std::vector<std::pair<std::shared_ptr<mip::IMesh>, std::shared_ptr<mip::IMaterial>>> m_spritePalette;
+    
+    // also sets up the scratch world of checkSnapshotRoundTrip()
+    bool regComponents(ecs::Manager& manager) {
+      manager.registerComponents(Components{});
+      
+      // hot enemy data walked in lockstep by movement, damage and spawner
+      manager.group<EnemyTag, Kinematics, CircleCollider, Health>();
+      
+      // walked every frame, matches are tracked on add/remove instead
+      manager.registerQuery<Lifetime>();
+      
+      regSnapshotHooks(manager);
       
       return true;
     }
+    // the rest of Components is block copied
+    void regSnapshotHooks(ecs::Manager& manager) {
+      manager.setSnapshotHook<Sprite>({
+        .save = [this](ecs::SnapshotWriter& w, const Sprite& s) {
+          auto it = std::find(m_spritePalette.begin(), m_spritePalette.end(), std::pair{s.mesh, s.material});
+          if(it == m_spritePalette.end()) it = m_spritePalette.insert(it, {s.mesh, s.material});
+          w.value(static_cast<uint32_t>(it - m_spritePalette.begin()));
+          w.value(s.uvRect);
+        },
+        .load = [this](ecs::SnapshotReader& r) {
+          const auto idx = r.value<uint32_t>();
+          Sprite s{.mesh = nullptr, .material = nullptr, .uvRect = r.value<glm::vec4>()};
+          if(idx < m_spritePalette.size()) std::tie(s.mesh, s.material) = m_spritePalette[idx];
+          return s;
+        }
+      });
+      manager.setSnapshotHook<StatusEffects>({
+        .save = [](ecs::SnapshotWriter& w, const StatusEffects& se) {
+          w.value(static_cast<uint32_t>(se.dots.size()));
+          w.write(se.dots.data(), se.dots.size() * sizeof(DoTCharge));
+        },
+        .load = [](ecs::SnapshotReader& r) {
+          StatusEffects se;
+          const auto cnt = r.value<uint32_t>();
+          if(r.fits(cnt, sizeof(DoTCharge))) {
+            se.dots.resize(cnt);
+            r.read(se.dots.data(), cnt * sizeof(DoTCharge));
+          }
+          return se;
+        }
+      });
+      // coroutine state can't be saved, restored scripts stay stopped
+      manager.setSnapshotHook<Script>({
+        .save = [](ecs::SnapshotWriter&, const Script&) {},
+        .load = [](ecs::SnapshotReader&) {return Script{.task = {nullptr}};}
+      });
+    }
     bool regAssets(mip::IRenderer* rend) {
       TextureLoader tLoader{rend};
       m_manager->registerAsset<std::shared_ptr<mip::ITexture>>(tLoader);
@@ -66,11 +86,14 @@ namespace game {
       return true;
     }
     bool regSystems(GLFWwindow* wnd, mip::IRenderer* rend) {
+      m_manager->setResource<CoScheduler>();
+      
       m_manager->registerSystem<PlayerControllerSystem>(wnd);
       m_manager->registerSystem<TileSystem>();
-      // m_manager->registerSystem<PatrolSystem>();
-      m_manager->registerSystem<MovementSystem>();
-      m_manager->registerSystem<AttachmentSystem>();
+      m_manager->registerSystem<PatrolSystem>();
+      // attachments follow their targets right after they moved
+      m_manager->registerSystem<ecs::Pipeline<MovementSystem, AttachmentSystem>>();
+      m_manager->registerSystem<SpatialSortSystem>();
       m_manager->registerSystem<LifetimeSystem>();
       m_manager->registerSystem<StatCalcSystem>(m_skillDB.get());
       m_manager->registerSystem<DamageSystem>();
@@ -85,6 +108,19 @@ namespace game {
       return true;
     }
     
+    bool loadWorld(std::span<const std::byte> data) {
+      if(auto res = m_manager->loadSnapshot(data); !res) {
+        Logger::error("Snapshot rejected: {}", res.error());
+        return false;
+      }
+      
+      // resources aren't part of the snapshot
+      const auto& players = m_manager->view<PlayerTag>().getOwners();
+      m_manager->setResource<PlayerRef>(players.empty() ? ecs::NULL_ENT : players.front());
+      if(!m_manager->tryResource<GameState>()) m_manager->setResource<GameState>();
+      return true;
+    }
+    
     bool createBars(float x, float y, ecs::EntID player, mip::IRenderer* rend) {
       auto uiMat = rend->createMaterial("../../assets/shaders/shader.spv");
       auto whiteTexHandle = m_manager->loadAsset<std::shared_ptr<mip::ITexture>>("../../assets/textures/whitepixel.png");
@@ -96,14 +132,14 @@ namespace game {
       
       // hp
       auto hpBg = m_manager->createEntity();
-      auto hpAtt = m_manager->addComponent(hpBg, AttachTo{ .target = player, .offset = {-30.f, -60.f} });
+      m_manager->addComponent(hpBg, AttachTo{ .target = player, .offset = {-30.f, -60.f} });
       auto hpKin = m_manager->addComponent(hpBg, Kinematics{ .z = 99, .scale = {60.f, 8.f} });
       m_manager->addComponent(hpBg, ColorTint{ .baseColor = {0.1f, 0.1f, 0.1f, 1.f} });
       m_manager->addComponent(hpBg, Sprite{ .mesh = rend->getUIQuad(), .material = uiMat });
 
       auto hpFill = m_manager->createEntity();
       m_manager->addComponent(hpFill, UIProgressBar{ .bType = BarType::HP, .maxW = 60.f });
-      m_manager->addComponent(hpFill, AttachTo{hpAtt});
+      m_manager->addComponent(hpFill, AttachTo{hpBg});
       m_manager->addComponent(hpFill, Kinematics{ .z = 100, .scale = hpKin.scale });
       m_manager->addComponent(hpFill, ColorTint{ .baseColor = {1.f, 0.f, 0.f, 1.f} });
       m_manager->addComponent(hpFill, Sprite{ .mesh = rend->getUIQuad(), .material = uiMat });
@@ -136,18 +172,25 @@ namespace game {
   public:
     
     Scene() {
-      m_manager = std::make_unique<ecs::Manager>();
+      m_manager = std::make_unique<ecs::Manager>(&m_compMem);
     }
     
     bool init(mip::Window* wnd, mip::IRenderer* rend) {
       m_skillDB = std::make_unique<SkillDB>(rend);
       
+      // main thread takes part in every parallel stage
+      size_t hw = std::thread::hardware_concurrency();
+      m_pool = std::make_unique<ThreadPool>(hw > 1 ? hw - 1 : 1);
+      m_manager->setThreadPool(m_pool.get());
+      
       if(
-           !regComponents()
+           !regComponents(*m_manager)
         || !regAssets(rend)
         || !regSystems(wnd->getWindow(), rend)
       ) return false;
       
+      Logger::info("Systems scheduled into {} stages.", m_manager->stageCount());
+      
       Logger::info("Scene initialized successfully.");
       return true;
     }
@@ -160,11 +203,8 @@ namespace game {
       // ImGui::ShowDemoWindow();
       
       glm::vec2 playerPos{0.f, 0.f};
-      auto& ks = m_manager->view<Kinematics>();
-      auto& ps = m_manager->view<PlayerTag>();
-      for(auto e : ps.getOwners()) {
-        playerPos = ks.get(e)->pos;
-        break;
+      if(auto kin = m_manager->view<Kinematics>().get(m_manager->resource<PlayerRef>().ent)) {
+        playerPos = kin->pos;
       }
       mip::CameraInfo camData{};
       camData.projection = glm::ortho(0.f, static_cast<float>(w), static_cast<float>(h), 0.f, -1.f, 1.f);
@@ -180,7 +220,7 @@ namespace game {
       vkRend->renderImGui();
       if(!rend->endFrame()) return false;
       
-      if(auto* ph = m_manager->getComponent<Health>(ps.getOwners()[0]); ph->cur <= 0) {
+      if(auto* ph = m_manager->getComponent<Health>(m_manager->resource<PlayerRef>().ent); ph->cur <= 0) {
         Logger::debug("Player died!");
         return false;
       }
@@ -188,6 +228,68 @@ namespace game {
       return true;
     }
     
+    bool saveSnapshot(const std::string& path) {
+      const auto data = m_manager->saveSnapshot();
+      std::ofstream file(path, std::ios::binary);
+      if(!file.write(reinterpret_cast<const char*>(data.data()), data.size())) {
+        Logger::error("Failed to write snapshot {}!", path);
+        return false;
+      }
+      
+      Logger::info("Saved {} entities ({} bytes) to {}.", m_manager->aliveCount(), data.size(), path);
+      return true;
+    }
+    
+    // only valid within the process that saved it, see m_spritePalette
+    bool loadSnapshot(const std::string& path) {
+      std::ifstream file(path, std::ios::binary | std::ios::ate);
+      if(!file) {
+        Logger::error("Failed to open snapshot {}!", path);
+        return false;
+      }
+      std::vector<std::byte> data(static_cast<size_t>(file.tellg()));
+      file.seekg(0);
+      file.read(reinterpret_cast<char*>(data.data()), data.size());
+      
+      if(!file || !loadWorld(data)) {
+        Logger::error("Failed to load snapshot {}!", path);
+        return false;
+      }
+      
+      Logger::info("Loaded {} entities from {}.", m_manager->aliveCount(), path);
+      return true;
+    }
+    
+    // Save, load into a scratch world, save that: the bytes have to match. The live
+    // world and its systems aren't touched, debug builds check it on startup.
+    bool checkSnapshotRoundTrip() {
+      const auto before = m_manager->saveSnapshot();
+      ecs::Manager copy;
+      regComponents(copy);
+      if(auto res = copy.loadSnapshot(before); !res) {
+        Logger::error("Snapshot round trip failed to load: {}", res.error());
+        return false;
+      }
+      
+      const auto after = copy.saveSnapshot();
+      if(before != after) {
+        Logger::error("Snapshot round trip changed the world ({} -> {} bytes)!", before.size(), after.size());
+        return false;
+      }
+      return true;
+    }
+    
+    // <basePath>.csv and <basePath>.json with per system timings
+    void dumpProfile(const std::string& basePath) const {
+      std::ofstream csv(basePath + ".csv");
+      m_manager->writeProfileCSV(csv);
+      std::ofstream json(basePath + ".json");
+      m_manager->writeProfileJSON(json);
+      
+      if(!csv || !json) Logger::error("Failed to write profile {}!", basePath);
+      else Logger::info("System profile written to {}.csv/.json", basePath);
+    }
+    
     bool createLevel(float width, float height, mip::IRenderer* rend, const std::string& txtrPath) {
       auto map = m_manager->createEntity();
       m_manager->addComponent(map, Kinematics{
@@ -244,7 +346,8 @@ namespace game {
     bool createPlayer(float x, float y, mip::IRenderer* rend, const std::string& txtrPath) {
       auto player = m_manager->createEntity();
       m_manager->addComponent(player, PlayerTag{});
-      m_manager->addComponent(player, GameState{});
+      m_manager->setResource<PlayerRef>(player);
+      m_manager->setResource<GameState>();
       m_manager->addComponent(player, PlayerStats{});
       m_manager->addComponent(player, PermanentStats{});
       m_manager->addComponent(player, Kinematics{
@@ -294,7 +397,6 @@ namespace game {
         .owner = player,
         .isEquipped = true
       });
-      m_manager->addComponent(auraGem, DirtyStatsTag{});
       
       return true;
     }
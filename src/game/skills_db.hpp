@@ -24,7 +24,8 @@ namespace game {
     float baseCd;
     uint8_t baseProj;
     
-    std::function<ecs::EntID(ecs::Manager&, glm::vec2, glm::vec2, const ActiveSkillGem&)> buildPrefub;
+    // components of one cast, instantiated by the caller as many times as needed
+    std::function<ecs::Prefab(glm::vec2, glm::vec2, const ActiveSkillGem&)> buildPrefub;
   };
   
   struct SupConf {
@@ -66,19 +67,18 @@ namespace game {
         .baseRadius = 15.f,
         .baseCd = 0.8f,
         .baseProj = 1,
-        .buildPrefub = [this](ecs::Manager& manager, glm::vec2 pos, glm::vec2 vel, const ActiveSkillGem& gem) {
-          ecs::EntID e = manager.createEntity();
+        .buildPrefub = [this](glm::vec2 pos, glm::vec2 vel, const ActiveSkillGem& gem) {
+          ecs::Prefab p;
           float timer = 3.f;
           
-          manager.addComponent(e, Active{});
-          manager.addComponent(e, WeaponTag{});
-          manager.addComponent(e, Kinematics{ .z = 15, .pos = pos, .scale = {gem.finalRadius * 2, gem.finalRadius * 2}, .vel = vel });
-          manager.addComponent(e, CircleCollider{.radius = gem.finalRadius});
-          manager.addComponent(e, DamageDealer{.amount = gem.finalDmg, .dmgType = SkillTag::Fire});
-          manager.addComponent(e, Lifetime{.curTimer = timer, .maxTimer = timer});
-          manager.addComponent(e, Sprite{.mesh = m_rend->getGlobalQuad(), .material = getMaterial("../../assets/textures/fb.png")});
+          p.add(WeaponTag{});
+          p.add(Kinematics{ .z = 15, .pos = pos, .scale = {gem.finalRadius * 2, gem.finalRadius * 2}, .vel = vel });
+          p.add(CircleCollider{.radius = gem.finalRadius});
+          p.add(DamageDealer{.amount = gem.finalDmg, .dmgType = SkillTag::Fire});
+          p.add(Lifetime{.curTimer = timer, .maxTimer = timer});
+          p.add(Sprite{.mesh = m_rend->getGlobalQuad(), .material = getMaterial("../../assets/textures/fb.png")});
           
-          return e;
+          return p;
         }
       };
       
@@ -90,18 +90,17 @@ namespace game {
         .baseRadius = 150.f,
         .baseCd = 0.5f,
         .baseProj = 0,
-        .buildPrefub = [this, rend](ecs::Manager& manager, glm::vec2 pos, glm::vec2 vel, const ActiveSkillGem& gem) {
-          ecs::EntID e = manager.createEntity();
+        .buildPrefub = [this, rend](glm::vec2 pos, glm::vec2 vel, const ActiveSkillGem& gem) {
+          ecs::Prefab p;
           
-          manager.addComponent(e, Active{});
-          manager.addComponent(e, WeaponTag{});
-          manager.addComponent(e, Kinematics{ .z = 8, .pos = pos, .scale = {gem.finalRadius * 2, gem.finalRadius * 2}, .vel = vel });
-          manager.addComponent(e, CircleCollider{.radius = gem.finalRadius});
-          manager.addComponent(e, DamageDealer{.amount = gem.finalDmg, .dmgType = SkillTag::Fire});
-          manager.addComponent(e, PulseCooldown{.curTimer = gem.finalCd, .maxTimer = gem.finalCd});
-          manager.addComponent(e, Sprite{.mesh = m_rend->getGlobalQuad(), .material = getMaterial("../../assets/textures/222.png")});
+          p.add(WeaponTag{});
+          p.add(Kinematics{ .z = 8, .pos = pos, .scale = {gem.finalRadius * 2, gem.finalRadius * 2}, .vel = vel });
+          p.add(CircleCollider{.radius = gem.finalRadius});
+          p.add(DamageDealer{.amount = gem.finalDmg, .dmgType = SkillTag::Fire});
+          p.add(PulseCooldown{.curTimer = gem.finalCd, .maxTimer = gem.finalCd});
+          p.add(Sprite{.mesh = m_rend->getGlobalQuad(), .material = getMaterial("../../assets/textures/222.png")});
           
-          return e;
+          return p;
         }
       };
       
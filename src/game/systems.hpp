@@ -13,37 +13,27 @@ namespace game {
   
   class VisualEffectsSystem : public ecs::ISystem {
   public:
+    using Writes = ecs::TypeList<FlashEffect, ColorTint>;
+    
     void update(ecs::Manager& manager, const float dT) override {
-      auto& clrs = manager.view<ColorTint>();
-      auto& flashes = manager.view<FlashEffect>();
-      
-      const auto& flashOwners = flashes.getOwners();
-      auto& flashDense = flashes.getDense();
+      auto& cmds = manager.commands();
       
-      if(flashDense.size() > 0) {
-        for(int i = static_cast<int>(flashDense.size()) - 1; i >= 0; --i) {
-          auto& flash = flashDense[i];
-          ecs::EntID e = flashOwners[i];
+      for(auto [e, flash, clr] : manager.query<FlashEffect, ColorTint>()) {
+        if(flash.curTime > 0.f) {
+          flash.curTime -= dT;
           
-          auto* clr = clrs.get(e);
-          if(!clr) continue;
+          float t = std::max(flash.curTime / flash.maxTime, 0.f);
           
-          if(flash.curTime > 0.f) {
-            flash.curTime -= dT;
-            
-            float t = std::max(flash.curTime / flash.maxTime, 0.f);
-            
-            clr->curColor = glm::mix(clr->baseColor, flash.color, t);
-            
-            if(flash.curTime <= 0.f) {
-              manager.removeComponent<FlashEffect>(e);
-              clr->curColor = clr->baseColor;
-            }
-          }
-          else {
-            if(clr) clr->curColor = clr->baseColor;
+          clr.curColor = glm::mix(clr.baseColor, flash.color, t);
+          
+          if(flash.curTime <= 0.f) {
+            cmds.remove<FlashEffect>(e);
+            clr.curColor = clr.baseColor;
           }
         }
+        else {
+          clr.curColor = clr.baseColor;
+        }
       }
     }
   };
@@ -56,24 +46,19 @@ namespace game {
     };
     
     mip::IRenderer* renderer;
-    std::vector<RenderItem> rendQ;
     
   public:
-    RenderSystem(mip::IRenderer* rend) : renderer(rend) {
-      rendQ.reserve(100);
-    }
+    RenderSystem(mip::IRenderer* rend) : renderer(rend) {}
     
     void update(ecs::Manager& manager, const float dT) override {
-      rendQ.clear();
+      std::pmr::vector<RenderItem> rendQ(manager.frameMemory());
+      rendQ.reserve(manager.view<Sprite>().size());
       auto& sprites = manager.view<Sprite>();
       auto& ks = manager.view<Kinematics>();
       auto& clrs = manager.view<ColorTint>();
       
-      for(ecs::EntID entity : sprites.getOwners()) {
-        Kinematics* k = ks.get(entity);
-        if(!k) continue;
-        
-        rendQ.push_back({entity, k->z});
+      for(auto [entity, spr, k] : manager.query<Sprite, Kinematics>()) {
+        rendQ.push_back({entity, k.z});
       }
       
       std::sort(rendQ.begin(), rendQ.end(), [](const auto& a, const auto& b) {
@@ -81,27 +66,25 @@ namespace game {
       });
       
       for(const auto& item : rendQ) {
-        auto* active = manager.getComponent<Active>(item.e);
-        if(active && !active->value) continue;
-        auto* spr = sprites.get(item.e);
-        auto* k = ks.get(item.e);
+        auto& spr = sprites.at(item.e);
+        auto k = ks.at(item.e);
         auto* clr = clrs.get(item.e);
         
         glm::mat4 model = glm::mat4(1.f);
-        model = glm::translate(model, glm::vec3(k->pos, 0.f));
-        model = glm::rotate(model, glm::radians(k->rot), glm::vec3(0.f, 0.f, 1.f));
-        model = glm::scale(model, glm::vec3(k->scale, 1.f));
+        model = glm::translate(model, glm::vec3(k.pos, 0.f));
+        model = glm::rotate(model, glm::radians(k.rot), glm::vec3(0.f, 0.f, 1.f));
+        model = glm::scale(model, glm::vec3(k.scale, 1.f));
         
         glm::ivec4 opts{};
-        opts.x = manager.getComponent<UITag>(item.e) ? 1 : 0;
+        opts.x = manager.hasComponent<UITag>(item.e) ? 1 : 0;
         mip::RenderInfo info{
           .transform = model,
-          .uvRect = spr->uvRect,
+          .uvRect = spr.uvRect,
           .color = clr ? clr->curColor : glm::vec4{1.f, 1.f, 1.f, 1.f},
           .options = opts
         };
         
-        renderer->submit(spr->mesh, spr->material, info);
+        renderer->submit(spr.mesh, spr.material, info);
       }
       
     }
@@ -120,34 +103,28 @@ namespace game {
       float scrW = static_cast<float>(w);
       float scrH = static_cast<float>(h);
       
-      auto& ks = manager.view<Kinematics>();
       auto& bars = manager.view<UIProgressBar>();
-      auto& anchors = manager.view<UIAnchor>();
       
       // step 1: layout
-      for(auto ae : anchors.getOwners()) {
-        auto* kin = ks.get(ae);
-        auto* anch = anchors.get(ae);
-        if(!kin || ! anch) continue;
-        
-        float outW = anch->baseSize.x;
-        float outH = anch->baseSize.y;
+      for(auto [ae, anch, kin] : manager.query<UIAnchor, Kinematics>()) {
+        float outW = anch.baseSize.x;
+        float outH = anch.baseSize.y;
         float outX = 0.f;
         float outY = 0.f;
         
         // h align, 0.0 < mesh.x < 1.0
-        switch(anch->hAlign) {
+        switch(anch.hAlign) {
           case AnchorH::Stretch: {
-            outW = scrW - anch->padding.x * 2.f;
-            outX = anch->padding.x;
+            outW = scrW - anch.padding.x * 2.f;
+            outX = anch.padding.x;
             break;
           }
           case AnchorH::Left: {
-            outX = anch->padding.x;
+            outX = anch.padding.x;
             break;
           }
           case AnchorH::Right: {
-            outX = scrW - outW - anch->padding.x;
+            outX = scrW - outW - anch.padding.x;
             break;
           }
           case AnchorH::Center: {
@@ -159,13 +136,13 @@ namespace game {
         
         // v align, -0.5 < mesh.y < 0.5
         float halfH = outH / 2.f;
-        switch(anch->vAlign) {
+        switch(anch.vAlign) {
           case AnchorV::Top: {
-            outY = anch->padding.y + halfH;
+            outY = anch.padding.y + halfH;
             break;
           }
           case AnchorV::Bottom: {
-            outY = scrH - anch->padding.y - halfH;
+            outY = scrH - anch.padding.y - halfH;
             break;
           }
           case AnchorV::Center: {
@@ -175,8 +152,8 @@ namespace game {
           [[unreachable]] default: break;
         }
         
-        kin->pos = {outX, outY};
-        kin->scale = {outW, outH};
+        kin.pos = {outX, outY};
+        kin.scale = {outW, outH};
         
         if(auto* bar = bars.get(ae)) {
           bar->maxW = outW;
@@ -184,25 +161,16 @@ namespace game {
       }
       
       // step 2: logic
-      Health* ph = nullptr;
-      Exp* pexp = nullptr;
-      
-      for(auto e : manager.view<PlayerTag>().getOwners()) {
-        ph = manager.getComponent<Health>(e);
-        pexp = manager.getComponent<Exp>(e);
-        
-        break;
-      }
+      ecs::EntID pe = manager.resource<PlayerRef>().ent;
+      if(!manager.isAlive(pe)) return;
+      Health* ph = manager.getComponent<Health>(pe);
+      Exp* pexp = manager.getComponent<Exp>(pe);
       
       if(!ph || !pexp) return;
       
-      for(auto be : bars.getOwners()) {
-        auto* kin = ks.get(be);
-        auto* bar = bars.get(be);
-        if(!kin || !bar) continue;
-        
+      for(auto [be, bar, kin] : manager.query<UIProgressBar, Kinematics>()) {
         float percent;
-        switch(bar->bType) {
+        switch(bar.bType) {
           case BarType::HP: {
             percent = std::max(ph->cur / ph->max, 0.f);
             break;
@@ -213,7 +181,7 @@ namespace game {
           }
           default: break;
         }
-          kin->scale.x = bar->maxW * percent;
+          kin.scale.x = bar.maxW * percent;
       }
     }
   };
@@ -221,24 +189,16 @@ namespace game {
   class GamePlayUISystem : public ecs::ISystem {
   public:
     void update(ecs::Manager& manager, const float dT) override {
-      ecs::EntID pe = ecs::NULL_ENT;
-      Exp* exp = nullptr;
-      GameState* state = nullptr;
-      Health* health = nullptr;
+      ecs::EntID pe = manager.resource<PlayerRef>().ent;
+      if(!manager.isAlive(pe)) return;
+      Exp* exp = manager.getComponent<Exp>(pe);
+      GameState* state = &manager.resource<GameState>();
+      Health* health = manager.getComponent<Health>(pe);
       ActiveSkillGem* aura = nullptr;
       
-      for(auto e : manager.view<PlayerTag>().getOwners()) {
-        pe = e;
-        exp = manager.getComponent<Exp>(pe);
-        state = manager.getComponent<GameState>(pe);
-        health = manager.getComponent<Health>(pe);
-        break;
-      }
-      
-      for(auto ge : manager.view<ActiveSkillGem>().getOwners()) {
-        auto* item = manager.getComponent<InventoryItem>(ge);
-        if(item && item->owner == pe && item->isEquipped) {
-          aura = manager.getComponent<ActiveSkillGem>(ge);
+      for(auto [ge, gem, item] : manager.query<ActiveSkillGem, InventoryItem>()) {
+        if(item.owner == pe && item.isEquipped) {
+          aura = &gem;
         }
       }
       
@@ -266,9 +226,29 @@ namespace game {
       ImGui::Text("Aura final dmg: %d", (int)aura->finalDmg);
       ImGui::End();
       
+      //per system costs
+      ImGuiIO& io = ImGui::GetIO();
+      ImGui::SetNextWindowPos(ImVec2(io.DisplaySize.x - 10, 10), ImGuiCond_FirstUseEver, ImVec2(1.f, 0.f));
+      ImGui::Begin("Systems", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoFocusOnAppearing);
+      if(ImGui::BeginTable("sysprof", 7, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit)) {
+        for(const char* col : {"System", "avg ms", "p95", "p99", "max", "ents", "ops"}) ImGui::TableSetupColumn(col);
+        ImGui::TableHeadersRow();
+        for(const ecs::SystemStats& st : manager.profile()) {
+          ImGui::TableNextRow();
+          ImGui::TableNextColumn(); ImGui::Text("%.*s", static_cast<int>(st.name.size()), st.name.data());
+          ImGui::TableNextColumn(); ImGui::Text("%.3f", st.avgMs);
+          ImGui::TableNextColumn(); ImGui::Text("%.3f", st.p95Ms);
+          ImGui::TableNextColumn(); ImGui::Text("%.3f", st.p99Ms);
+          ImGui::TableNextColumn(); ImGui::Text("%.3f", st.maxMs);
+          ImGui::TableNextColumn(); ImGui::Text("%.0f", st.avgTouched);
+          ImGui::TableNextColumn(); ImGui::Text("%.1f", st.avgOps);
+        }
+        ImGui::EndTable();
+      }
+      ImGui::End();
+      
       //lvl up rendering
       if(state->isLvlUp) {
-        ImGuiIO& io = ImGui::GetIO();
         ImGui::SetNextWindowPos(ImVec2(io.DisplaySize.x * 0.5f, io.DisplaySize.y * 0.5f), ImGuiCond_Always, ImVec2(0.5f, 0.5f));
         ImGui::SetNextWindowSize(ImVec2(600, 400));
         
@@ -285,7 +265,7 @@ namespace game {
         if(ImGui::Button("Select##1", ImVec2(160, 30))) {
           if(auto* pStats = manager.getComponent<PermanentStats>(pe)) {
             pStats->incAoERadius += 0.2f;
-            manager.addComponent(pe, DirtyStatsTag{});
+            manager.markChanged<PermanentStats>(pe);
           }
           
           state->isLvlUp = false;
@@ -300,13 +280,10 @@ namespace game {
         ImGui::TextWrapped("Increase base aura damage");
         ImGui::SetCursorPosY(260);
         if(ImGui::Button("Select##2", ImVec2(160, 30))) {
-          for(auto ge : manager.view<ActiveSkillGem>().getOwners()) {
-            auto* gem = manager.getComponent<ActiveSkillGem>(ge);
-            auto* item = manager.getComponent<InventoryItem>(ge);
-            
-            if(item && item->owner == pe && gem->skillIdHash == Hash("aura")) {
-              gem->lvl++;
-              manager.addComponent(pe, DirtyStatsTag{});
+          for(auto [ge, gem, item] : manager.query<ActiveSkillGem, InventoryItem>()) {
+            if(item.owner == pe && gem.skillIdHash == Hash("aura")) {
+              gem.lvl++;
+              manager.markChanged<ActiveSkillGem>(ge);
               break;
             }
           }
@@ -323,53 +300,35 @@ namespace game {
   
   class TileSystem : public ecs::ISystem {
   public:
+    using Reads = ecs::TypeList<BgTile>;
+    using Writes = ecs::TypeList<Kinematics>;
+    
     static constexpr float tileSize = 2'500.f;
     
     void update(ecs::Manager& manager, const float dT) override {
-      glm::vec2 playerPos{0.f};
-      for(auto& e : manager.view<PlayerTag>().getOwners()) {
-        playerPos = manager.getComponent<Kinematics>(e)->pos;
-        break;
-      }
+      ecs::EntID pe = manager.resource<PlayerRef>().ent;
+      if(!manager.isAlive(pe)) return;
+      glm::vec2 playerPos = manager.getComponent<Kinematics>(pe)->pos;
       
-      auto& tiles = manager.view<BgTile>();
-      auto& ks = manager.view<Kinematics>();
-      for(auto& e : tiles.getOwners()) {
-        auto* tile = tiles.get(e);
-        auto* kin = ks.get(e);
-        float targetX = std::round(playerPos.x / tileSize) * tileSize + tile->offset.x * tileSize;
-        float targetY = std::round(playerPos.y / tileSize) * tileSize + tile->offset.y * tileSize;
+      for(auto [e, tile, kin] : manager.query<BgTile, Kinematics>()) {
+        float targetX = std::round(playerPos.x / tileSize) * tileSize + tile.offset.x * tileSize;
+        float targetY = std::round(playerPos.y / tileSize) * tileSize + tile.offset.y * tileSize;
         
-        kin->pos = {targetX, targetY};
+        kin.pos = {targetX, targetY};
       }
     }
   };
   
   class AnimSystem : public ecs::ISystem {
   public:
+    using Writes = ecs::TypeList<Animator, Sprite>;
+    
+    static bool runIf(ecs::Manager& manager) {return notPaused(manager);}
+    
     void update(ecs::Manager& manager, const float dT) override {
       
-      //check game state
-      for (auto e : manager.view<game::PlayerTag>().getOwners()) {
-        if (auto* state = manager.getComponent<game::GameState>(e)) {
-          if (state->isPaused) return;
-        }
-        break;
-      }
-      
-      auto& animators = manager.view<Animator>();
-      auto& sprites = manager.view<Sprite>();
-      auto& acts = manager.view<Active>();
-      
-      for(auto ae : animators.getOwners()) {
-        auto* act = acts.get(ae);
-        if(act && !act->value) continue;
-        
-        auto* anim = animators.get(ae);
-        auto* spr = sprites.get(ae);
-        
-        if(!spr) continue;
-        
+      for(auto [ae, animator, spr] : manager.query<Animator, Sprite>()) {
+        auto* anim = &animator;
         anim->timer += dT;
         
         if(anim->timer >= anim->frameTime) {
@@ -390,39 +349,107 @@ namespace game {
         float uvX = (actFrame % anim->cols) * frameW;
         float uvY = (actFrame % anim->rows) * frameH;
         
-        spr->uvRect = {uvX, uvY, frameW, frameH};
+        spr.uvRect = {uvX, uvY, frameW, frameH};
       }
     }
   };
   
   class MovementSystem : public ecs::ISystem {
   public:
+    using Writes = ecs::TypeList<Kinematics>;
+    
+    static bool runIf(ecs::Manager& manager) {return notPaused(manager);}
+    
     MovementSystem() {}
     
     void update(ecs::Manager& manager, const float dT) override {
       
-      //check game state
-      for (auto e : manager.view<game::PlayerTag>().getOwners()) {
-        if (auto* state = manager.getComponent<game::GameState>(e)) {
-          if (state->isPaused) return;
-        }
-        break;
-      }
-      
+      auto& enemies = manager.group<EnemyTag, Kinematics, CircleCollider, Health>();
       auto& ks = manager.view<Kinematics>();
       
-      const auto& kinOwners = ks.getOwners();
-      auto& kinDense = ks.getDense();
+      // grouped head of Kinematics holds enabled enemies only, pooled ones sit past it
+      glm::vec2* pos = ks.field<&Kinematics::pos>();
+      const glm::vec2* vel = ks.field<&Kinematics::vel>();
+      const size_t grouped = enemies.size();
+      manager.parallelFor<Kinematics>(0, grouped, [&](size_t b, size_t e) {
+        for(size_t i = b; i < e; ++i) pos[i] += vel[i] * dT;
+      });
       
-      for(size_t i = 0; i < kinDense.size(); ++i) {
-        ecs::EntID e = kinOwners[i];
-        auto* active = manager.getComponent<Active>(e);
-        if(active && !active->value) continue;
-        
-        auto& k = kinDense[i];
-        k.pos += k.vel * dT;
+      const auto& owners = ks.getOwners();
+      manager.parallelFor<Kinematics>(grouped, ks.size(), [&](size_t b, size_t e) {
+        for(size_t i = b; i < e; ++i) {
+          if(!manager.isEnabled(owners[i])) continue;
+          pos[i] += vel[i] * dT;
+        }
+      });
+      
+    }
+  };
+  
+  // Keeps grouped enemies in Morton (Z-order) of their grid cell, so enemies close in
+  // the world are close in memory for the damage/collision loops. Between two sorts only
+  // the few that crossed a cell are out of place, insertion sort fixes those in ~O(n).
+  class SpatialSortSystem : public ecs::ISystem {
+    static constexpr float cellSize = 64.f;
+    static constexpr uint32_t sortEvery = 30; // frames
+    
+    uint32_t frame = 0;
+    
+    // low 16 bits to the even bits
+    static uint32_t spread(uint32_t v) {
+      v &= 0xFFFF;
+      v = (v | (v << 8)) & 0x00FF00FF;
+      v = (v | (v << 4)) & 0x0F0F0F0F;
+      v = (v | (v << 2)) & 0x33333333;
+      v = (v | (v << 1)) & 0x55555555;
+      return v;
+    }
+    
+    // cells are biased so the origin sits mid range, far away ones wrap (only costs locality)
+    static uint32_t morton(glm::vec2 p) {
+      const auto cx = static_cast<uint32_t>(static_cast<int32_t>(std::floor(p.x / cellSize)) + 0x8000);
+      const auto cy = static_cast<uint32_t>(static_cast<int32_t>(std::floor(p.y / cellSize)) + 0x8000);
+      return spread(cx) | (spread(cy) << 1);
+    }
+    
+  public:
+    // reorder() swaps slots of every storage in the group
+    using Writes = ecs::TypeList<EnemyTag, Kinematics, CircleCollider, Health>;
+    
+    static bool runIf(ecs::Manager& manager) {return notPaused(manager);}
+    
+    void update(ecs::Manager& manager, const float dT) override {
+      if(++frame < sortEvery) return;
+      frame = 0;
+      
+      auto& enemies = manager.group<EnemyTag, Kinematics, CircleCollider, Health>();
+      const glm::vec2* pos = manager.view<Kinematics>().field<&Kinematics::pos>();
+      const size_t cnt = enemies.size();
+      
+      std::pmr::vector<uint64_t> keys(cnt, manager.frameMemory()); // morton << 32 | group slot
+      size_t unsorted = 0;
+      for(size_t i = 0; i < cnt; ++i) {
+        keys[i] = (static_cast<uint64_t>(morton(pos[i])) << 32) | i;
+        if(i > 0 && (keys[i - 1] >> 32) > (keys[i] >> 32)) ++unsorted;
       }
+      if(unsorted == 0) return;
       
+      // fresh spawns land at the end in random order, a full sort is cheaper then
+      if(unsorted > cnt / 16) {
+        std::sort(keys.begin(), keys.end());
+      }
+      else {
+        for(size_t i = 1; i < cnt; ++i) {
+          const uint64_t k = keys[i];
+          size_t j = i;
+          for(; j > 0 && (keys[j - 1] >> 32) > (k >> 32); --j) keys[j] = keys[j - 1];
+          keys[j] = k;
+        }
+      }
+      
+      std::pmr::vector<uint32_t> order(cnt, manager.frameMemory());
+      for(size_t i = 0; i < cnt; ++i) order[i] = static_cast<uint32_t>(keys[i]);
+      enemies.reorder(order);
     }
   };
   
@@ -430,74 +457,44 @@ namespace game {
     GLFWwindow* m_wnd;
     
   public:
+    static bool runIf(ecs::Manager& manager) {return notPaused(manager);}
+    
     PlayerControllerSystem(GLFWwindow* wnd) : m_wnd(wnd) {}
     
     void update(ecs::Manager& manager, const float dT) override{
       
-      //check game state
-      for (auto e : manager.view<game::PlayerTag>().getOwners()) {
-        if (auto* state = manager.getComponent<game::GameState>(e)) {
-          if (state->isPaused) return;
-        }
-        break;
-      }
+      auto kin = manager.view<Kinematics>().get(manager.resource<PlayerRef>().ent);
+      if(!kin) return;
       
-      auto& ks = manager.view<Kinematics>();
-      auto& ps = manager.view<PlayerTag>();
+      glm::vec2 moveDir{0.f, 0.f};
       
-      for(ecs::EntID e : ps.getOwners()) {
-        auto* kin = ks.get(e);
-        if(!kin) continue;
-        
-        glm::vec2 moveDir{0.f, 0.f};
-        
-        if (glfwGetKey(m_wnd, GLFW_KEY_W) == GLFW_PRESS) moveDir.y -= 1.f;
-        if (glfwGetKey(m_wnd, GLFW_KEY_S) == GLFW_PRESS) moveDir.y += 1.f;
-        if (glfwGetKey(m_wnd, GLFW_KEY_A) == GLFW_PRESS) moveDir.x -= 1.f;
-        if (glfwGetKey(m_wnd, GLFW_KEY_D) == GLFW_PRESS) moveDir.x += 1.f;
-        
-        if(glm::length(moveDir) > 0.f) {
-          moveDir = glm::normalize(moveDir);
-        }
-        
-        kin->vel = moveDir * kin->speed;
+      if (glfwGetKey(m_wnd, GLFW_KEY_W) == GLFW_PRESS) moveDir.y -= 1.f;
+      if (glfwGetKey(m_wnd, GLFW_KEY_S) == GLFW_PRESS) moveDir.y += 1.f;
+      if (glfwGetKey(m_wnd, GLFW_KEY_A) == GLFW_PRESS) moveDir.x -= 1.f;
+      if (glfwGetKey(m_wnd, GLFW_KEY_D) == GLFW_PRESS) moveDir.x += 1.f;
+      
+      if(glm::length(moveDir) > 0.f) {
+        moveDir = glm::normalize(moveDir);
       }
+      
+      kin->vel = moveDir * kin->speed;
     }
   };
   
+  // Drives every coroutine through the CoScheduler resource: new Scripts are started,
+  // then only the ones whose co_yield delay ran out get resumed.
   class PatrolSystem : public ecs::ISystem {
   public:
+    static bool runIf(ecs::Manager& manager) {return notPaused(manager);}
+    
     void update(ecs::Manager& manager, const float dT) override {
       
-      //check game state
-      for (auto e : manager.view<game::PlayerTag>().getOwners()) {
-        if (auto* state = manager.getComponent<game::GameState>(e)) {
-          if (state->isPaused) return;
-        }
-        break;
+      auto& sched = manager.resource<CoScheduler>();
+      if(manager.view<Script>().changedSince(lastRun)) {
+        for(auto [e, scr] : manager.query<Script>().added<Script>(lastRun)) sched.start(scr.task);
       }
       
-      auto& scripts = manager.view<Script>();
-      
-      for(ecs::EntID e : scripts.getOwners()) {
-        auto* active = manager.getComponent<Active>(e);
-        if(active && !active->value) continue;
-        auto* scr = scripts.get(e);
-        if(!scr->active || !scr->task.handle) continue;
-        
-        scr->timer -= dT;
-        
-        if(scr->timer <= 0.f) {
-          bool running = scr->task.resume();
-          
-          if(running) {
-            scr->timer = scr->task.handle.promise().waitTime;
-          }
-          else {
-            scr->active = false;
-          }
-        }
-      }
+      sched.advance(dT);
     }
   };
   
@@ -505,13 +502,14 @@ namespace game {
     mip::IRenderer* m_rend;
     std::vector<ecs::EntID> m_pool;
     Task m_waveTask{nullptr};
-    float m_waveTimer = 0.f;
     float m_spawnRadius = 800.f;
     std::shared_ptr<mip::IMaterial> m_enemyMat;
+    ecs::Prefab m_enemyPrefab;
     
     float m_speed; //temp need enemyConfigs later
     
   public:
+    static bool runIf(ecs::Manager& manager) {return notPaused(manager);}
     
     inline static uint32_t diedCount = 0;
     
@@ -519,197 +517,184 @@ namespace game {
       m_enemyMat = m_rend->createMaterial("../../assets/shaders/shader.spv");
       auto tex = m_rend->createTexture("../../assets/textures/mob1.png", false);
       m_enemyMat->setTexture(0, tex);
-    }
-    
-    ecs::EntID createEnemy(ecs::Manager& manager, glm::vec2 spawnPos) {
-      ecs::EntID e;
-      if(!m_pool.empty()) {
-        e = m_pool.back();
-        m_pool.pop_back();
-        manager.getComponent<Active>(e)->value = true;
-        auto* kin = manager.getComponent<Kinematics>(e);
-        kin->pos = spawnPos;
-        kin->speed = m_speed;
-        manager.getComponent<Health>(e)->cur = manager.getComponent<Health>(e)->max;
-        
-        if(auto* se = manager.getComponent<StatusEffects>(e))
-          manager.removeComponent<StatusEffects>(e);
-        if(auto* fe = manager.getComponent<FlashEffect>(e))
-          manager.removeComponent<FlashEffect>(e);
-        if(auto* clr = manager.getComponent<ColorTint>(e)) {
-          clr->curColor = clr->baseColor;
-        }
-        // manager.getComponent<Health>(e)->iFrames = 0.5f;
-      }
-      else {
-        e = manager.createEntity();
       
-        manager.addComponent(e, EnemyTag{});
-        manager.addComponent(e, Active{});
-        manager.addComponent(e, Kinematics{
+      // position and speed are set per spawn
+      m_enemyPrefab
+        .add(EnemyTag{})
+        .add(Kinematics{
           .z = 9,
-          .pos = {spawnPos.x, spawnPos.y},
           .scale = {50.f, 50.f},
-          .rot = 0.f,
-          .speed = m_speed
-        });
-        manager.addComponent(e, CircleCollider{.radius = manager.getComponent<Kinematics>(e)->scale.x / 2.f});
-        manager.addComponent(e, Health{
+          .rot = 0.f
+        })
+        .add(CircleCollider{.radius = 25.f})
+        .add(Health{
+          .cur = 30.f,
           .max = 30.f,
           .iFrames = 0.5f
-        });
-        manager.getComponent<Health>(e)->cur = manager.getComponent<Health>(e)->max;
-        manager.addComponent(e, Sprite{
+        })
+        .add(Sprite{
           .mesh = m_rend->getGlobalQuad(),
           .material = m_enemyMat
-        });
-        manager.addComponent(e, ColorTint{});
-        
-        Logger::debug("Enemy was created: {}", e);
+        })
+        .add(ColorTint{});
+    }
+    
+    void respawn(ecs::Manager& manager, ecs::EntID e, glm::vec2 spawnPos) {
+      if(!manager.hasComponent<Kinematics>(e) || !manager.hasComponent<Health>(e)) return;
+      
+      // enabling moves e into the group range, pointers only after it
+      manager.enable(e);
+      auto kin = manager.getComponent<Kinematics>(e);
+      auto hp = manager.getComponent<Health>(e);
+      kin->pos = spawnPos;
+      kin->speed = m_speed;
+      hp->cur = hp->max;
+      
+      if(auto* se = manager.getComponent<StatusEffects>(e))
+        manager.removeComponent<StatusEffects>(e);
+      if(auto* fe = manager.getComponent<FlashEffect>(e))
+        manager.removeComponent<FlashEffect>(e);
+      if(auto* clr = manager.getComponent<ColorTint>(e)) {
+        clr->curColor = clr->baseColor;
       }
-      
-      return e;
+      // manager.getComponent<Health>(e)->iFrames = 0.5f;
     }
     
     Task wave(ecs::Manager& manager) {
       float speed = 100.f;
       while(true) {
-        spawnCircle(manager, 5, speed);
-        co_yield 10.f;
-        
-        spawnCircle(manager, 10, speed + 50.f);
-        co_yield 10.f;
-        
-        spawnCircle(manager, 15, speed + 100.f);
-        co_yield 10;
+        for(int k = 0; k < 3; ++k) {
+          // waves hold while the player is dead
+          while(!manager.isAlive(manager.resource<PlayerRef>().ent)) co_yield 1.f;
+          
+          spawnCircle(manager, 5 * (k + 1), speed + 50.f * k);
+          co_yield 10.f;
+        }
       }
     }
     
     void spawnCircle(ecs::Manager& manager, int count, float speed) {
       m_speed = speed;
       glm::vec2 plPos{0.f, 0.f};
-      for(auto e : manager.view<PlayerTag>().getOwners()) {
-        plPos = manager.getComponent<Kinematics>(e)->pos;
-        break;
+      if(auto kin = manager.view<Kinematics>().get(manager.resource<PlayerRef>().ent)) {
+        plPos = kin->pos;
       }
       
+      // dead pooled enemies come back first, the rest is created in one batch
+      std::erase_if(m_pool, [&](ecs::EntID e) {return !manager.isAlive(e);});
+      const size_t reused = std::min(m_pool.size(), static_cast<size_t>(count));
+      const std::vector<ecs::EntID> fresh = manager.instantiate(m_enemyPrefab, count - reused);
+      if(!fresh.empty()) Logger::debug("{} enemies were created", fresh.size());
+      
       for(int i = 0; i < count; ++i) {
         float angle = (360.f / count) * i;
         float rad = glm::radians(angle);
         
         glm::vec2 spawnPos = plPos + glm::vec2(cos(rad), sin(rad)) * m_spawnRadius;
         
-        ecs::EntID e = createEnemy(manager, spawnPos);
+        if(static_cast<size_t>(i) < reused) {
+          respawn(manager, m_pool.back(), spawnPos);
+          m_pool.pop_back();
+        }
+        else {
+          auto kin = manager.getComponent<Kinematics>(fresh[i - reused]);
+          kin->pos = spawnPos;
+          kin->speed = m_speed;
+        }
         
         // auto* vel = manager.getComponent<Velocity>(e);
         // vel->value = glm::normalize(plPos - spawnPos) * m_speed;
       }
     }
     
+    // the pool is taken from the loaded world: its disabled enemies, the wave starts over
+    void onLoad(ecs::Manager& manager) override {
+      m_waveTask = Task{nullptr};
+      m_pool.clear();
+      for(ecs::EntID e : manager.view<EnemyTag>().getOwners()) {
+        if(!manager.isEnabled(e)) m_pool.push_back(e);
+      }
+    }
+    
     void update(ecs::Manager& manager, const float dT) override {
       
-      ecs::EntID pe = ecs::NULL_ENT;
-      
-      //check game state
-      for (auto e : manager.view<game::PlayerTag>().getOwners()) {
-        pe = e;
-        if (auto* state = manager.getComponent<game::GameState>(e)) {
-          if (state->isPaused) return;
-        }
-        break;
-      }
+      ecs::EntID pe = manager.resource<PlayerRef>().ent;
+      if(!manager.isAlive(pe)) return;
       
       if(!m_waveTask.handle) {
         m_waveTask = wave(manager);
-      }
-      
-      m_waveTimer -= dT;
-      if(m_waveTimer <= 0.f) {
-        if(m_waveTask.resume()) {
-          m_waveTimer = m_waveTask.handle.promise().waitTime;
-        }
+        manager.resource<CoScheduler>().start(m_waveTask);
       }
       
       // move vectors
       glm::vec2 plPos{0.f, 0.f};
       plPos = manager.getComponent<Kinematics>(pe)->pos;
       
-      auto& es = manager.view<EnemyTag>();
-      for(auto e : es.getOwners()) {
-        auto* act = manager.getComponent<Active>(e);
-        if(act && !act->value) continue;
-        auto* kin = manager.getComponent<Kinematics>(e);
-        
-        glm::vec2 dir = plPos - kin->pos;
-        if(glm::length(dir) > 0.0001f) kin->vel = glm::normalize(dir) * kin->speed;
-        else kin->vel = {0.f, 0.f};
-      }
+      auto& enemies = manager.group<EnemyTag, Kinematics, CircleCollider, Health>();
+      auto& ks = manager.view<Kinematics>();
+      const glm::vec2* gPos = ks.field<&Kinematics::pos>();
+      const float* gSpeed = ks.field<&Kinematics::speed>();
+      glm::vec2* gVel = ks.field<&Kinematics::vel>();
+      manager.parallelFor<Kinematics>(0, enemies.size(), [&](size_t b, size_t e) {
+        for(size_t i = b; i < e; ++i) {
+          glm::vec2 dir = plPos - gPos[i];
+          if(glm::length(dir) > 0.0001f) gVel[i] = glm::normalize(dir) * gSpeed[i];
+          else gVel[i] = {0.f, 0.f};
+        }
+      });
       
       // check HP
       auto* pexp = manager.getComponent<Exp>(pe);
-      auto& healths = manager.view<Health>();
-      for (auto e : manager.view<EnemyTag>().getOwners()) {
-        auto* active = manager.getComponent<Active>(e);
-        if (active->value && healths.get(e)->cur <= 0) {
-          active->value = false;
+      const ecs::EntID* ents = enemies.entities();
+      const Health* hps = enemies.data<Health>();
+      const size_t died = m_pool.size();
+      for(size_t i = 0; i < enemies.size(); ++i) {
+        if (hps[i].cur <= 0) {
           pexp->cur += 1;
           Logger::debug("Enemy died! #{}", diedCount++);
-          m_pool.push_back(e);
+          m_pool.push_back(ents[i]);
           // exp
         }
       }
+      // disabling moves them out of the group range, so not while walking it
+      for(size_t k = died; k < m_pool.size(); ++k) manager.disable(m_pool[k]);
     }
     
   };
   
   class DamageSystem : public ecs::ISystem {
+  public:
+    using Reads = ecs::TypeList<PlayerTag, EnemyTag, Kinematics, CircleCollider, DamageDealer, AppliesDoT, Sprite>;
+    using Writes = ecs::TypeList<Health, PulseCooldown, Pierce, StatusEffects>;
     
-    std::vector<ecs::EntID> m_toDestroy;
+    static bool runIf(ecs::Manager& manager) {return notPaused(manager);}
     
-  public:
     void update(ecs::Manager& manager, const float dT) override {
       
-      //check game state
-      for (auto e : manager.view<game::PlayerTag>().getOwners()) {
-        if (auto* state = manager.getComponent<game::GameState>(e)) {
-          if (state->isPaused) return;
-        }
-        break;
-      }
-      
-      m_toDestroy.clear();
-      
-      auto& healths = manager.view<Health>();
-      auto& enemies = manager.view<EnemyTag>();
-      auto& circles = manager.view<CircleCollider>();
-      auto& ks = manager.view<Kinematics>();
-      auto& dds = manager.view<DamageDealer>();
-      auto& acts = manager.view<Active>();
+      auto& cmds = manager.commands();
       auto& pulses = manager.view<PulseCooldown>();
-      auto& players = manager.view<PlayerTag>();
+      
+      // enemies are walked as packed arrays of the owning group
+      auto& enemies = manager.group<EnemyTag, Kinematics, CircleCollider, Health>();
+      const ecs::EntID* eEnts = enemies.entities();
+      const glm::vec2* ePos = manager.view<Kinematics>().field<&Kinematics::pos>();
+      const CircleCollider* eCols = enemies.data<CircleCollider>();
+      Health* eHps = enemies.data<Health>();
+      const size_t enemyCnt = enemies.size();
       
       
       // 1st iter by weapons
-      for(auto we : dds.getOwners()) {
-        auto* wact = acts.get(we);
-        if(wact && !wact->value) continue;
+      for(auto [we, dmg, wc, wt] : manager.query<DamageDealer, CircleCollider, Kinematics>()) {
         auto* pulse = pulses.get(we);
         if(pulse && pulse->curTimer > 0.f) continue;
-        auto* wc = circles.get(we);
-        auto* wt = ks.get(we);
-        if(!wc || !wt) continue;
-        auto* dmg = dds.get(we);
         
         // 2nd iter by enemies
-        for(auto ee : enemies.getOwners()) {
-          auto* eact = acts.get(ee);
-          if(eact && !eact->value) continue;
-          auto* ehp = healths.get(ee);
-          auto* ec = circles.get(ee);
-          auto* et = ks.get(ee);
-          if(!ec || !et) continue;
+        for(size_t i = 0; i < enemyCnt; ++i) {
+          ecs::EntID ee = eEnts[i];
+          auto& ehp = eHps[i];
+          auto& ec = eCols[i];
           
-          float finalDmg = dmg->amount;
+          float finalDmg = dmg.amount;
           // if(auto* res = manager.getComponent<Resistances>(ee)) {
           //   float targetRes = 0.f;
           //   if(dmg->dmgType == SkillTag::Fire) targetRes = res->fire;
@@ -725,36 +710,38 @@ namespace game {
           //   finalDmg *= (1.f - targetRes);
           // }
           
-          float dist = glm::distance(wt->pos, et->pos);
-          if(dist < (wc->radius + ec->radius)) {
+          float dist = glm::distance(wt.pos, ePos[i]);
+          if(dist < (wc.radius + ec.radius)) {
             if(pulse) {
               if(pulse->curTimer <= 0.f) {
-                ehp->cur -= finalDmg;
+                ehp.cur -= finalDmg;
               }
             }
-            else ehp->cur -= finalDmg; // once damage
+            else ehp.cur -= finalDmg; // once damage
             // flash effect after gaining damage
             float time = 0.2f;
-            manager.addComponent(ee, FlashEffect{ .maxTime = time, .curTime = time, .color = {1.f, 0.f, 0.f, 1.f} });
+            cmds.add(ee, FlashEffect{ .maxTime = time, .curTime = time, .color = {1.f, 0.f, 0.f, 1.f} });
             
             if(auto* applies = manager.getComponent<AppliesDoT>(we)) {
-              auto* statuses = manager.getComponent<StatusEffects>(ee);
-              if(!statuses) {
-                statuses = &manager.addComponent(ee, StatusEffects{});
-              }
-              statuses->dots.emplace_back(DoTCharge{
+              DoTCharge charge{
                 .damage = applies->dmgPerTick,
                 .tickRate = applies->tickRate,
                 .curTickTimer = applies->tickRate,
                 .lifetime = applies->duration
-              });
+              };
+              if(auto* statuses = manager.getComponent<StatusEffects>(ee)) {
+                statuses->dots.emplace_back(charge);
+              }
+              else {
+                cmds.add(ee, StatusEffects{.dots = {charge}});
+              }
             }
             
             if(auto* pierce = manager.getComponent<Pierce>(we)) {
               pierce->count--;
               if(pierce->count <= 0) {
-                // wact->value = false;
-                m_toDestroy.emplace_back(we);
+                // manager.disable(we);
+                cmds.destroy(we);
                 break;
               }
             }
@@ -765,29 +752,21 @@ namespace game {
       }
       
       //player & enemy colls
-      for(auto pe : players.getOwners()) {
-        auto* ph = healths.get(pe);
-        auto* pt = ks.get(pe);
-        auto* pc = circles.get(pe);
-        for(auto ee : enemies.getOwners()) {
-          auto* eact = acts.get(ee);
-          if(eact && !eact->value) continue;
-          auto* ehp = healths.get(ee);
-          auto* ec = circles.get(ee);
-          auto* et = ks.get(ee);
-          
-          if(!ec || !et) continue;
+      for(auto [pe, ptag, ph, pt, pc] : manager.query<PlayerTag, Health, Kinematics, CircleCollider>()) {
+        for(size_t i = 0; i < enemyCnt; ++i) {
+          auto& ehp = eHps[i];
+          auto& ec = eCols[i];
         
-          float dist = glm::distance(pt->pos, et->pos);
-          if(dist < (pc->radius + ec->radius)) {
-            ph->cur -= 5.f;
+          float dist = glm::distance(pt.pos, ePos[i]);
+          if(dist < (pc.radius + ec.radius)) {
+            ph.cur -= 5.f;
             if(auto* spr = manager.getComponent<Sprite>(pe)) {
               // flash effect after gaining damage
               float time = 0.3f;
-              manager.addComponent(pe, FlashEffect{ .maxTime = time, .curTime = time, .color = {1.f, 0.f, 0.f, 1.f} });
+              cmds.add(pe, FlashEffect{ .maxTime = time, .curTime = time, .color = {1.f, 0.f, 0.f, 1.f} });
             }
             // Logger::info("Get hit!");
-            ehp->cur = 0;
+            ehp.cur = 0;
           }
           
         }
@@ -796,15 +775,8 @@ namespace game {
       }
       
       // cd dots
-      for(auto e : pulses.getOwners()) {
-        auto* act = acts.get(e);
-        if(act && !act->value) continue;
-        if(auto* pulse = pulses.get(e); pulse->curTimer > 0.f) pulse->curTimer -= dT;
-      }
-      
-      // destroy projectiles
-      for (auto we : m_toDestroy) {
-        manager.destroyEntity(we);
+      for(auto [e, pulse] : manager.query<PulseCooldown>()) {
+        if(pulse.curTimer > 0.f) pulse.curTimer -= dT;
       }
       
     }
@@ -814,57 +786,47 @@ namespace game {
   class StatCalcSystem : public ecs::ISystem {
     SkillDB* m_skillDB;
   public:
+    using Reads = ecs::TypeList<PlayerTag, PermanentStats, InventoryItem, LinkedGems, SupGem>;
+    using Writes = ecs::TypeList<PlayerStats, ActiveSkillGem, DamageDealer, CircleCollider, Kinematics, PulseCooldown>;
+    
     StatCalcSystem(SkillDB* db) : m_skillDB(db) {}
     
     void update(ecs::Manager& manager, const float dT) override {
-      for(auto pe : manager.view<PlayerTag>().getOwners()) {
-        if(manager.getComponent<DirtyStatsTag>(pe)) {
-          auto* pStats = manager.getComponent<PlayerStats>(pe);
-          auto* prStats = manager.getComponent<PermanentStats>(pe);
-          if(!pStats) continue;
-          
-          pStats->incFireDmg = 0.f;
-          pStats->incColdDmg = 0.f;
-          pStats->incAoERadius = 0.f;
-          pStats->cdReduction = 0.f;
-          pStats->extraProj = 0;
-          
-          //TODO: gear cycle
-          
-          pStats->incFireDmg = prStats->incFireDmg;
-          pStats->incColdDmg = prStats->incColdDmg;
-          pStats->incAoERadius = prStats->incAoERadius;
-          pStats->cdReduction = prStats->cdReduction;
-          pStats->extraProj = prStats->extraProj;
-          
-          manager.removeComponent<DirtyStatsTag>(pe);
-          
-          for(auto ge : manager.view<ActiveSkillGem>().getOwners()) {
-            auto* item = manager.getComponent<InventoryItem>(ge);
-            if(item && item->owner == pe && item->isEquipped) {
-              manager.addComponent(ge, DirtyStatsTag{});
-            }
-          }
-        }
+      for(auto [pe, tag, prStats, pStats] : manager.query<PlayerTag, PermanentStats, PlayerStats>().changed<PermanentStats>(lastRun)) {
+        pStats.incFireDmg = 0.f;
+        pStats.incColdDmg = 0.f;
+        pStats.incAoERadius = 0.f;
+        pStats.cdReduction = 0.f;
+        pStats.extraProj = 0;
+        
+        //TODO: gear cycle
+        
+        pStats.incFireDmg = prStats.incFireDmg;
+        pStats.incColdDmg = prStats.incColdDmg;
+        pStats.incAoERadius = prStats.incAoERadius;
+        pStats.cdReduction = prStats.cdReduction;
+        pStats.extraProj = prStats.extraProj;
+        
+        manager.markChanged<PlayerStats>(pe);
       }
       
-      auto& dirtyGems = manager.view<DirtyStatsTag>();
-      for(int i = static_cast<int>(dirtyGems.getDense().size()) - 1; i >= 0; --i) {
-        ecs::EntID ge = dirtyGems.getOwners()[i];
-        auto* gem = manager.getComponent<ActiveSkillGem>(ge);
-        auto* item = manager.getComponent<InventoryItem>(ge);
-        if(!gem || !item || !m_skillDB->activeSkills.count(gem->skillIdHash)) continue;
+      // equipped gems are rebuilt when edited, (re)equipped or when owner stats changed
+      for(auto [ge, gem, item] : manager.query<ActiveSkillGem, InventoryItem>()) {
+        if(!item.isEquipped || !m_skillDB->activeSkills.count(gem.skillIdHash)) continue;
+        if(!manager.isChanged<ActiveSkillGem>(ge, lastRun) &&
+           !manager.isChanged<InventoryItem>(ge, lastRun) &&
+           !manager.isChanged<PlayerStats>(item.owner, lastRun)) continue;
         
-        auto* pStats = manager.getComponent<PlayerStats>(item->owner);
-        const auto& baseConf = m_skillDB->activeSkills[gem->skillIdHash];
+        auto* pStats = manager.getComponent<PlayerStats>(item.owner);
+        const auto& baseConf = m_skillDB->activeSkills[gem.skillIdHash];
         
-        gem->tagsMask = baseConf.tagsMask;
-        gem->finalDmg = baseConf.baseDmg * (1.f + (gem->lvl * 0.5f));
-        gem->curLvlDmg = gem->finalDmg;
-        gem->finalCd = baseConf.baseCd;
-        gem->finalRadius = baseConf.baseRadius;
-        gem->finalProj = baseConf.baseProj;
-        gem->dmgMultiplier = 1.f;
+        gem.tagsMask = baseConf.tagsMask;
+        gem.finalDmg = baseConf.baseDmg * (1.f + (gem.lvl * 0.5f));
+        gem.curLvlDmg = gem.finalDmg;
+        gem.finalCd = baseConf.baseCd;
+        gem.finalRadius = baseConf.baseRadius;
+        gem.finalProj = baseConf.baseProj;
+        gem.dmgMultiplier = 1.f;
         
         float totalIncDmg = 0.f;
         float totalIncRadius = 0.f;
@@ -875,42 +837,40 @@ namespace game {
           for(auto se : links->gems) {
             if(auto* sg = manager.getComponent<SupGem>(se)) {
               if(m_skillDB->supSkills.count(sg->supIdHash)) {
-                m_skillDB->supSkills[sg->supIdHash].applyMods(*gem, sg->lvl);
+                m_skillDB->supSkills[sg->supIdHash].applyMods(gem, sg->lvl);
               }
             }
           }
         }
         
-        if(gem->tagsMask & SkillTag::Fire) {
+        if(gem.tagsMask & SkillTag::Fire) {
           totalIncDmg += pStats->incFireDmg;
         }
-        if(gem->tagsMask & SkillTag::Cold) {
+        if(gem.tagsMask & SkillTag::Cold) {
           totalIncDmg += pStats->incColdDmg;
         }
-        if(gem->tagsMask & SkillTag::AoE) {
+        if(gem.tagsMask & SkillTag::AoE) {
           totalIncRadius += pStats->incAoERadius;
         }
         //TODO: other mods
         
-        gem->finalDmg = gem->finalDmg * (1.f + totalIncDmg) * gem->dmgMultiplier;
-        gem->finalRadius = gem->finalRadius * (1.f + totalIncRadius);
+        gem.finalDmg = gem.finalDmg * (1.f + totalIncDmg) * gem.dmgMultiplier;
+        gem.finalRadius = gem.finalRadius * (1.f + totalIncRadius);
         
-        if (gem->spawnedEnt != ecs::NULL_ENT) {
-          if (auto* dmg = manager.getComponent<DamageDealer>(gem->spawnedEnt)) {
-            dmg->amount = gem->finalDmg;
+        if (manager.isAlive(gem.spawnedEnt)) {
+          if (auto* dmg = manager.getComponent<DamageDealer>(gem.spawnedEnt)) {
+            dmg->amount = gem.finalDmg;
           }
-          if (auto* col = manager.getComponent<CircleCollider>(gem->spawnedEnt)) {
-            col->radius = gem->finalRadius;
+          if (auto* col = manager.getComponent<CircleCollider>(gem.spawnedEnt)) {
+            col->radius = gem.finalRadius;
           }
-          if (auto* kin = manager.getComponent<Kinematics>(gem->spawnedEnt)) {
-            kin->scale = {gem->finalRadius * 2.f, gem->finalRadius * 2.f};
+          if (auto kin = manager.getComponent<Kinematics>(gem.spawnedEnt)) {
+            kin->scale = {gem.finalRadius * 2.f, gem.finalRadius * 2.f};
           }
-          if (auto* pulse = manager.getComponent<PulseCooldown>(gem->spawnedEnt)) {
-            pulse->maxTimer = gem->finalCd;
+          if (auto* pulse = manager.getComponent<PulseCooldown>(gem.spawnedEnt)) {
+            pulse->maxTimer = gem.finalCd;
           }
         }
-        
-        manager.removeComponent<DirtyStatsTag>(ge);
       }
     }
   };
@@ -923,14 +883,9 @@ namespace game {
     CombatSystem(SkillDB* db, GLFWwindow* wnd) : m_skillDB(db), m_wnd(wnd) {}
     
     void update(ecs::Manager& manager, const float dT) override {
-      ecs::EntID pe = ecs::NULL_ENT;
-      glm::vec2 pos{0.f};
-      for(auto e : manager.view<PlayerTag>().getOwners()) {
-        pe = e;
-        pos = manager.getComponent<Kinematics>(pe)->pos;
-        break;
-      }
-      if(pe == ecs::NULL_ENT) return;
+      ecs::EntID pe = manager.resource<PlayerRef>().ent;
+      if(!manager.isAlive(pe)) return;
+      glm::vec2 pos = manager.getComponent<Kinematics>(pe)->pos;
       
       //TODO: fire dir, cast etc
       bool isClicking = glfwGetMouseButton(m_wnd, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS;
@@ -938,21 +893,21 @@ namespace game {
       glfwGetCursorPos(m_wnd, &x, &y);
       glm::vec2 targetDir{static_cast<float>(x), static_cast<float>(y)};
       
-      for(auto ge :  manager.view<ActiveSkillGem>().getOwners()) {
-        auto* gem = manager.getComponent<ActiveSkillGem>(ge);
-        auto* item = manager.getComponent<InventoryItem>(ge);
-        if(!item || !item->isEquipped || item->owner != pe) continue;
+      for(auto [ge, gemRef, itemRef] : manager.query<ActiveSkillGem, InventoryItem>()) {
+        auto* gem = &gemRef;
+        auto* item = &itemRef;
+        if(!item->isEquipped || item->owner != pe) continue;
         if(!m_skillDB->activeSkills.count(gem->skillIdHash)) continue;
         
         const auto& config = m_skillDB->activeSkills[gem->skillIdHash];
         
         if(config.castType == CastType::Persistent && isClicking) {
-          if(gem->spawnedEnt == ecs::NULL_ENT) {
-            gem->spawnedEnt = config.buildPrefub(manager, pos, {0.f, 0.f}, *gem);
-            manager.addComponent(gem->spawnedEnt, AttachTo{.target = pe});
+          if(!manager.isAlive(gem->spawnedEnt)) {
+            gem->spawnedEnt = manager.instantiate(config.buildPrefub(pos, {0.f, 0.f}, *gem).add(AttachTo{.target = pe}));
           }
           else {
-            if(auto* act = manager.getComponent<Active>(gem->spawnedEnt)) act->value = !act->value;
+            if(manager.isEnabled(gem->spawnedEnt)) manager.disable(gem->spawnedEnt);
+            else manager.enable(gem->spawnedEnt);
           }
           continue;
         }
@@ -961,10 +916,8 @@ namespace game {
           if(gem->curCdTimer > 0.f) gem->curCdTimer -= dT;
           
           if(isClicking && gem->curCdTimer <= 0.f) {
-            for(int i = 0; i < gem->finalProj; ++i) {
-              glm::vec2 vel = glm::normalize(targetDir) * 300.f;
-              config.buildPrefub(manager, pos, vel, *gem);
-            }
+            glm::vec2 vel = glm::normalize(targetDir) * 300.f;
+            manager.instantiate(config.buildPrefub(pos, vel, *gem), gem->finalProj);
             gem->curCdTimer = gem->finalCd;
           }
         }
@@ -974,102 +927,122 @@ namespace game {
   
   class StatusSystem : public ecs::ISystem {
   public:
+    using Writes = ecs::TypeList<StatusEffects, Health>;
+    
+    static bool runIf(ecs::Manager& manager) {return notPaused(manager);}
+    
     void update(ecs::Manager& manager, const float dT) override {
       
-      //check game state
-      for (auto e : manager.view<game::PlayerTag>().getOwners()) {
-        if (auto* state = manager.getComponent<game::GameState>(e)) {
-          if (state->isPaused) return;
-        }
-        break;
-      }
-      
-      auto& healths = manager.view<Health>();
-      auto& statuses = manager.view<StatusEffects>();
-      auto& acts = manager.view<Active>();
-      
-      for(auto se : statuses.getOwners()) {
-        auto* act = acts.get(se);
-        if(act && !act->value) continue;
-        
-        auto* hp = healths.get(se);
-        auto* status = statuses.get(se);
-        
-        if(!hp || !status) continue;
-        
-        for(int i = static_cast<int>(status->dots.size()) - 1; i >= 0; --i) {
-          auto& dot = status->dots[i];
+      for(auto [se, status, hp] : manager.query<StatusEffects, Health>()) {
+        for(int i = static_cast<int>(status.dots.size()) - 1; i >= 0; --i) {
+          auto& dot = status.dots[i];
           dot.lifetime -= dT;
           dot.curTickTimer -= dT;
           
           if(dot.curTickTimer <= 0.f) {
-            hp->cur -= dot.damage;
+            hp.cur -= dot.damage;
             dot.curTickTimer = dot.tickRate;
           }
           
           if(dot.lifetime <= 0.f) {
-            status->dots.erase(status->dots.begin() + i);
+            status.dots.erase(status.dots.begin() + i);
           }
         }
       }
     }
   };
   
+  // AttachTo storage is kept sorted by depth, so one pass over it places every parent
+  // before its children. Slots whose parent didn't move are skipped, a static subtree
+  // costs one compare at its root. Mark AttachTo changed after editing target/offset.
   class AttachmentSystem : public ecs::ISystem {
-    void update(ecs::Manager& manager, const float dT) override {
+    static constexpr uint32_t ROOT = UINT32_MAX; // target isn't attached itself
+    
+    std::vector<uint32_t> parents; // slot of the target in the AttachTo array
+    std::vector<glm::vec2> placed; // position last written per slot
+    std::vector<uint8_t> moved;
+    
+    // depths, storage order and parent slots, after any AttachTo add/remove/change
+    void rebuild(ecs::Manager& manager) {
+      auto& atts = manager.view<AttachTo>();
+      const size_t cnt = atts.size();
+      
+      for(size_t i = 0; i < cnt; ++i) {
+        size_t depth = 0;
+        for(auto* up = atts.get(atts.byIndex(i).target); up && depth <= cnt; up = atts.get(up->target)) ++depth;
+        assert(depth <= cnt && "AttachTo cycle!");
+        atts.byIndex(i).depth = static_cast<uint16_t>(depth);
+      }
+      manager.sortBy<AttachTo>([](const AttachTo& a, const AttachTo& b) {return a.depth < b.depth;});
       
-      //check game state
-      for (auto e : manager.view<game::PlayerTag>().getOwners()) {
-        if (auto* state = manager.getComponent<game::GameState>(e)) {
-          if (state->isPaused) return;
-        }
-        break;
+      parents.resize(cnt);
+      for(size_t i = 0; i < cnt; ++i) {
+        const ecs::EntID target = atts.byIndex(i).target;
+        parents[i] = atts.has(target) ? static_cast<uint32_t>(atts.index(target)) : ROOT;
       }
+      placed.resize(cnt);
+      moved.resize(cnt);
+    }
+    
+  public:
+    using Writes = ecs::TypeList<AttachTo, Kinematics>;
+    
+    // slots refer to the old storage order, next update rebuilds
+    void onLoad(ecs::Manager&) override {parents.clear();}
+    
+    static bool runIf(ecs::Manager& manager) {return notPaused(manager);}
+    
+    void update(ecs::Manager& manager, const float dT) override {
       
-      auto& acts = manager.view<Active>();
-      auto& atts = manager.view<AttachTo>().getOwners();
-      for(auto e : atts) {
-        auto* act = acts.get(e);
-        if(act && !act->value) continue;
-        auto te = manager.getComponent<AttachTo>(e)->target;
-        auto* ks = manager.getComponent<Kinematics>(te);
-        auto* itsKs = manager.getComponent<Kinematics>(e);
-        if(ks && itsKs)
-          itsKs->pos = ks->pos + manager.getComponent<AttachTo>(e)->offset;
+      auto& atts = manager.view<AttachTo>();
+      auto& ks = manager.view<Kinematics>();
+      const bool full = atts.size() != parents.size() || atts.changedSince(lastRun);
+      if(full) rebuild(manager);
+      
+      const ecs::EntID* owners = atts.getOwners().data();
+      for(size_t i = 0; i < parents.size(); ++i) {
+        const uint32_t parent = parents[i];
+        moved[i] = 0;
+        if(parent != ROOT && !moved[parent] && !full) continue;
+        
+        const AttachTo& att = atts.byIndex(i);
+        glm::vec2 base;
+        if(parent != ROOT) base = placed[parent];
+        // stale target (destroyed, index recycled) is simply not found
+        else if(auto targetKs = ks.get(att.target)) base = targetKs->pos;
+        else {
+          // the entity stays where it is, its children still follow it
+          auto itsKs = ks.get(owners[i]);
+          if(!itsKs || (!full && itsKs->pos == placed[i])) continue;
+          placed[i] = itsKs->pos;
+          moved[i] = 1;
+          continue;
+        }
+        
+        const glm::vec2 pos = base + att.offset;
+        if(!full && pos == placed[i]) continue;
+        
+        placed[i] = pos;
+        moved[i] = 1;
+        if(auto itsKs = ks.get(owners[i])) itsKs->pos = pos;
       }
     }
   };
   
   class LifetimeSystem : public ecs::ISystem {
+  public:
+    using Writes = ecs::TypeList<Lifetime>;
     
-    std::vector<ecs::EntID> m_toDestroy;
+    static bool runIf(ecs::Manager& manager) {return notPaused(manager);}
     
     void update(ecs::Manager& manager, const float dT) override {
       
-      //check game state
-      for (auto e : manager.view<game::PlayerTag>().getOwners()) {
-        if (auto* state = manager.getComponent<game::GameState>(e)) {
-          if (state->isPaused) return;
+      auto& cmds = manager.commands();
+      for(auto [e, te] : manager.cachedQuery<Lifetime>()) {
+        te.curTimer -= dT;
+        if(te.curTimer <= 0.f) {
+          cmds.destroy(e);
         }
-        break;
-      }
-      
-      m_toDestroy.clear();
-      
-      auto& acts = manager.view<Active>();
-      for(auto e : manager.view<Lifetime>().getOwners()) {
-        auto* act = acts.get(e);
-        if(act && !act->value) continue;
-        auto* te = manager.getComponent<Lifetime>(e);
-        if(te) {
-          te->curTimer -= dT;
-          if(te->curTimer <= 0.f) m_toDestroy.emplace_back(e);
-        }
-        if(te->curTimer <= 0) act->value = false;
-      }
-      
-      for(auto e : m_toDestroy) {
-        manager.destroyEntity(e);
       }
     }
   };